@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+//Allocator of blocks of one fixed size
+//Blocks are cut out of big slabs that are never given back to the system until the pool is destroyed,
+//so memory doesn't fragment and, once the pool has grown, allocation never calls malloc.
+//Every thread has its own cache of free blocks and only exchanges them in batches with
+//a global lock-free list, so threads rarely touch shared memory.
+//Thread index has to be unique for threads using the pool at the same time (like TaskScheduler::threadIndex())
+class BlockPool{
+    public:
+        struct statistics{
+            //Blocks currently given out
+            size_t live;
+            //Highest number of live blocks so far
+            size_t peak;
+            //Blocks in slabs that are not given out (in caches or the global list)
+            size_t free;
+            size_t blockSize;
+        };
+
+    private:
+        static constexpr uint32_t noBlock = UINT32_MAX;
+        static constexpr int maxSlabs = 4096;
+        //Every block starts with its own index (written once, when its slab is made) and, while it's free,
+        //index of the next free block. Only the part after them is given out, so deallocate() reads
+        //the index right before the pointer instead of searching for the slab
+        static constexpr size_t headerSize = 8;
+
+        size_t blockSize;
+        uint32_t blocksPerSlab;
+
+        //Slabs are only added, so reading a pointer of existing slab needs no lock
+        std::atomic<char*> slabs[maxSlabs];
+        std::atomic<int> slabsAmount{0};
+        std::mutex growMutex;
+
+        //Head of the global list of free blocks: index of the block in low 32 bits
+        //and a counter in high 32 bits, which changes on every push, so a head
+        //that was popped and pushed back in the meantime isn't mistaken for the same one (ABA problem)
+        std::atomic<uint64_t> globalHead{noBlock};
+
+        //Free blocks kept by every thread, taken and given back in batches of cacheBatch
+        struct alignas(64) threadCache{
+            std::vector<uint32_t> blocks;
+        };
+
+        std::vector<threadCache> caches;
+        int cacheBatch;
+
+        std::atomic<size_t> live{0};
+        std::atomic<size_t> peak{0};
+
+        char* blockAddress(uint32_t index){
+            return slabs[index / blocksPerSlab].load(std::memory_order_acquire) + (size_t)(index % blocksPerSlab) * blockSize;
+        }
+
+        uint32_t& nextFree(uint32_t index){
+            return *reinterpret_cast<uint32_t*>(blockAddress(index) + sizeof(uint32_t));
+        }
+
+        void pushGlobal(uint32_t index){
+            uint64_t head = globalHead.load(std::memory_order_acquire);
+            uint64_t newHead;
+
+            do{
+                nextFree(index) = (uint32_t)head;
+                newHead = ((head >> 32) + 1) << 32 | index;
+            }while(!globalHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_acquire));
+        }
+
+        uint32_t popGlobal(){
+            uint64_t head = globalHead.load(std::memory_order_acquire);
+
+            while((uint32_t)head != noBlock){
+                uint32_t index = (uint32_t)head;
+                uint64_t newHead = (head >> 32) << 32 | nextFree(index);
+
+                if(globalHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire)){
+                    return index;
+                }
+            }
+
+            return noBlock;
+        }
+
+        //Adds a new slab and puts all of its blocks on the global list
+        bool grow(){
+            std::lock_guard<std::mutex> lock(growMutex);
+
+            int slab = slabsAmount.load();
+
+            if(slab == maxSlabs) return false;
+
+            char* memory = static_cast<char*>(std::malloc(blockSize * blocksPerSlab));
+
+            if(!memory) return false;
+
+            slabs[slab].store(memory, std::memory_order_release);
+            slabsAmount.store(slab + 1, std::memory_order_release);
+
+            for(uint32_t i = 0; i < blocksPerSlab; i++){
+                *reinterpret_cast<uint32_t*>(memory + (size_t)i * blockSize) = slab * blocksPerSlab + i;
+                pushGlobal(slab * blocksPerSlab + i);
+            }
+
+            return true;
+        }
+
+    public:
+        BlockPool(size_t blockSize, int threadsAmount, uint32_t blocksPerSlab = 256, int cacheBatch = 16)
+        : blockSize(std::max(blockSize, headerSize + sizeof(uint32_t))), blocksPerSlab(blocksPerSlab), caches(std::max(threadsAmount, 1)), cacheBatch(cacheBatch){
+            for(std::atomic<char*>& slab : slabs){
+                slab.store(nullptr);
+            }
+
+            for(threadCache& cache : caches){
+                cache.blocks.reserve(cacheBatch * 2);
+            }
+        }
+
+        ~BlockPool(){
+            for(int i = 0; i < slabsAmount; i++){
+                std::free(slabs[i].load());
+            }
+        }
+
+        BlockPool(const BlockPool&) = delete;
+        BlockPool& operator=(const BlockPool&) = delete;
+
+        //Returns nullptr only if the pool can't grow anymore
+        void* allocate(int thread){
+            std::vector<uint32_t>& cache = caches[thread].blocks;
+
+            if(cache.empty()){
+                for(int i = 0; i < cacheBatch; i++){
+                    uint32_t index = popGlobal();
+
+                    if(index == noBlock){
+                        if(!grow()) break;
+
+                        index = popGlobal();
+
+                        if(index == noBlock) break;
+                    }
+
+                    cache.push_back(index);
+                }
+
+                if(cache.empty()) return nullptr;
+            }
+
+            uint32_t index = cache.back();
+            cache.pop_back();
+
+            size_t current = ++live;
+            size_t highest = peak.load();
+
+            while(current > highest && !peak.compare_exchange_weak(highest, current)){}
+
+            return blockAddress(index) + headerSize;
+        }
+
+        //Thread -1 gives the block straight back to the global list, for threads without their own index
+        void deallocate(void* block, int thread){
+            uint32_t index = *reinterpret_cast<uint32_t*>(static_cast<char*>(block) - headerSize);
+
+            live--;
+
+            if(thread < 0){
+                pushGlobal(index);
+                return;
+            }
+
+            std::vector<uint32_t>& cache = caches[thread].blocks;
+            cache.push_back(index);
+
+            //Too many free blocks in one thread, half of them goes back to others
+            if((int)cache.size() >= cacheBatch * 2){
+                for(int i = 0; i < cacheBatch; i++){
+                    pushGlobal(cache.back());
+                    cache.pop_back();
+                }
+            }
+        }
+
+        //Usable bytes of every block
+        size_t getBlockSize() const{
+            return blockSize - headerSize;
+        }
+
+        statistics getStatistics() const{
+            size_t total = (size_t)slabsAmount.load() * blocksPerSlab;
+            size_t currentLive = live.load();
+
+            return {currentLive, peak.load(), total - currentLive, blockSize - headerSize};
+        }
+};
+
+//Singly linked list of fixed size blocks from a BlockPool, each holding several values
+//Only supports adding at the end, walking through and clearing, which is all that
+//lists of cells and buffered changes need. T has to be trivially copyable.
+template <typename T>
+class PooledList{
+    private:
+        struct block{
+            block* next;
+            int count;
+        };
+
+        BlockPool* pool = nullptr;
+        block* first = nullptr;
+        block* last = nullptr;
+        size_t amount = 0;
+
+        int capacity() const{
+            return (pool->getBlockSize() - sizeof(block)) / sizeof(T);
+        }
+
+        static T* values(block* currentBlock){
+            return reinterpret_cast<T*>(reinterpret_cast<char*>(currentBlock) + sizeof(block));
+        }
+
+    public:
+        class iterator{
+            private:
+                block* currentBlock;
+                int position;
+
+            public:
+                iterator(block* currentBlock, int position) : currentBlock(currentBlock), position(position){}
+
+                T& operator*() const{
+                    return values(currentBlock)[position];
+                }
+
+                iterator& operator++(){
+                    position++;
+
+                    if(position == currentBlock->count){
+                        currentBlock = currentBlock->next;
+                        position = 0;
+                    }
+
+                    return *this;
+                }
+
+                bool operator!=(const iterator& other) const{
+                    return currentBlock != other.currentBlock || position != other.position;
+                }
+        };
+
+        PooledList(){}
+
+        PooledList(BlockPool* pool) : pool(pool){}
+
+        PooledList(const PooledList&) = delete;
+        PooledList& operator=(const PooledList&) = delete;
+
+        PooledList(PooledList&& other){
+            *this = std::move(other);
+        }
+
+        PooledList& operator=(PooledList&& other){
+            if(this != &other){
+                clear(-1);
+
+                pool = other.pool;
+                first = other.first;
+                last = other.last;
+                amount = other.amount;
+
+                other.first = nullptr;
+                other.last = nullptr;
+                other.amount = 0;
+            }
+
+            return *this;
+        }
+
+        ~PooledList(){
+            clear(-1);
+        }
+
+        //Returns false if the pool ran out of memory
+        bool push_back(const T& value, int thread){
+            if(!last || last->count == capacity()){
+                block* newBlock = static_cast<block*>(pool->allocate(thread));
+
+                if(!newBlock) return false;
+
+                newBlock->next = nullptr;
+                newBlock->count = 0;
+
+                if(last) last->next = newBlock;
+                else first = newBlock;
+
+                last = newBlock;
+            }
+
+            new(values(last) + last->count) T(value);
+            last->count++;
+            amount++;
+
+            return true;
+        }
+
+        //Gives all blocks back to the pool, to the cache of given thread
+        void clear(int thread){
+            while(first){
+                block* next = first->next;
+
+                pool->deallocate(first, thread);
+                first = next;
+            }
+
+            last = nullptr;
+            amount = 0;
+        }
+
+        size_t size() const{
+            return amount;
+        }
+
+        bool empty() const{
+            return amount == 0;
+        }
+
+        iterator begin() const{
+            return iterator(first, 0);
+        }
+
+        iterator end() const{
+            return iterator(nullptr, 0);
+        }
+};
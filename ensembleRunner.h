@@ -0,0 +1,126 @@
+#pragma once
+
+#include "liquidSimulation.h"
+#include "taskScheduler.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+//Runs many independent simulations of small matrices on one thread pool, without windows
+//Every simulation is a single task that does all of its steps on one thread, as one stripe. Small matrix stays
+//in the cache of that thread and no time is spent on synchronizing stripes, which for tiny
+//matrices costs more than updating them. Only as many simulations as there are threads exist at once.
+class EnsembleRunner{
+    public:
+        //Settings of one simulation
+        struct member{
+            float compression;
+            float flowDivider;
+            //Steps are done in frames of that many, like in the window
+            int stepsPerFrame;
+            //Maximal number of steps
+            int steps;
+            //Stops at the end of the frame in which the matrix settled
+            bool untilSettled;
+        };
+
+        struct summary{
+            member settings;
+            LiquidSimulation::statistics statistics;
+            //Water in every row at the end
+            std::vector<double> rowMass;
+            long stepsDone;
+            int framesDone;
+            //-1 if the matrix didn't settle
+            long settledStep;
+            //Time of all steps (milliseconds)
+            double time;
+        };
+
+    private:
+        TaskScheduler& scheduler;
+        nlohmann::json settings;
+        olc::vi2d matrixSize;
+        std::vector<std::string> map;
+
+        summary runMember(const member& settingsOfMember){
+            LiquidSimulation simulation;
+
+            simulation.loadSettings(settings);
+            simulation.create(matrixSize, false);
+            simulation.setParameters(settingsOfMember.compression, settingsOfMember.flowDivider);
+            simulation.loadMap(map);
+
+            int stepsPerFrame = std::max(settingsOfMember.stepsPerFrame, 1);
+            int framesDone = 0;
+
+            auto start = std::chrono::steady_clock::now();
+
+            while(simulation.getStepsDone() < settingsOfMember.steps){
+                for(int i = 0; i < stepsPerFrame && simulation.getStepsDone() < settingsOfMember.steps; i++){
+                    simulation.step();
+                }
+
+                framesDone++;
+
+                if(settingsOfMember.untilSettled && simulation.isSettled()) break;
+            }
+
+            double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            return {
+                settingsOfMember,
+                simulation.getStatistics(),
+                simulation.getRowMass(),
+                simulation.getStepsDone(),
+                framesDone,
+                simulation.getSettledStep(),
+                time
+            };
+        }
+
+    public:
+        //Every simulation uses given settings (like config.json) and starts from the map (see LiquidSimulation::loadMap())
+        EnsembleRunner(TaskScheduler& scheduler, const nlohmann::json& simulationSettings, olc::vi2d matrixSize, std::vector<std::string> map)
+        : scheduler(scheduler), settings(simulationSettings), matrixSize(matrixSize), map(std::move(map)){
+            //Threads come from the shared pool, pages of tiny matrices aren't worth being huge
+            settings["threads"] = 1;
+            settings["pinThreads"] = "none";
+            settings["hugePages"] = "none";
+            //Stripes moved by measured time would make results differ between runs
+            settings["balanceStripes"] = false;
+            //One stripe covering the whole matrix, updated directly on the thread of the task
+            settings["stripeHeight"] = std::max(matrixSize.y, 2);
+        }
+
+        //Summaries are in the same order as members
+        std::vector<summary> run(const std::vector<member>& members){
+            std::vector<summary> summaries(members.size());
+            TaskScheduler::taskGroup group;
+
+            for(int i = 0; i < (int)members.size(); i++){
+                scheduler.submit(group, [this, &members, &summaries, i]{ summaries[i] = runMember(members[i]); });
+            }
+
+            scheduler.wait(group);
+
+            return summaries;
+        }
+
+        //Water falling from a dam in the left third of a closed box
+        static std::vector<std::string> damBreakMap(olc::vi2d size){
+            std::vector<std::string> rows(size.y, std::string(size.x, '.'));
+
+            for(int y = 0; y < size.y; y++){
+                for(int x = 0; x < size.x; x++){
+                    bool isWall = x == 0 || x == size.x - 1 || y == size.y - 1;
+
+                    if(isWall) rows[y][x] = '#';
+                    else if(x < size.x / 3 && y >= size.y / 4) rows[y][x] = '~';
+                }
+            }
+
+            return rows;
+        }
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include "olcPixelGameEngine.h"
+#include "taskScheduler.h"
+#include "pngEncoder.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+//Writes frames on its own threads, so the simulation only waits when it's far ahead of them
+//Frames are taken from a fixed pool of buffers, filled by the caller and handed over with submit().
+//When all buffers are still waiting to be written, acquire() blocks (back pressure), so memory
+//stays bounded however slow the output is. Buffers are reused, so nothing is allocated per frame
+//once they have grown to the size of the image.
+//Output is one of:
+// - PNG files: name given + frame number + ".png", every frame is encoded and written by the thread that took it
+// - "-": raw RGBA frames to the standard output
+// - "|command": raw RGBA frames to the standard input of the command (like a video encoder)
+//Raw frames are written in the order they were submitted in.
+//Output that can't be written (like a command that exited) only makes failed() true, following frames are dropped.
+class FrameExporter{
+    public:
+        struct frame{
+            //r g b a bytes, row after row
+            std::vector<olc::Pixel> pixels;
+            int width = 0;
+            int height = 0;
+
+            //Set in submit()
+            long index = 0;
+        };
+
+    private:
+        std::string output;
+        bool isRaw = false;
+        FILE* stream = nullptr;
+        bool isPipe = false;
+
+        //Own threads, simulation threads are busy with steps
+        std::unique_ptr<TaskScheduler> scheduler;
+        TaskScheduler::taskGroup group;
+
+        //---Buffer pool---
+        std::vector<std::unique_ptr<frame>> frames;
+        std::vector<frame*> freeFrames;
+        std::mutex poolMutex;
+        std::condition_variable frameFreed;
+        //------
+
+        //---Ordered writing of raw frames---
+        //Frames encoded before the ones in front of them, waiting for their turn
+        std::map<long, frame*> waitingFrames;
+        long nextToWrite = 0;
+        //Only one thread writes at a time, others leave their frames in waitingFrames
+        bool isWriting = false;
+        std::mutex writeMutex;
+        //------
+
+        long submitted = 0;
+        //Frames that reached the output, fewer than submitted when it failed
+        std::atomic<long> written{0};
+        std::atomic<bool> hasFailed{false};
+        //Time the caller spent in acquire() waiting for a free buffer (seconds)
+        double waitTime = 0;
+
+        void release(frame* finished){
+            {
+                std::lock_guard<std::mutex> lock(poolMutex);
+                freeFrames.push_back(finished);
+            }
+
+            frameFreed.notify_one();
+        }
+
+        void writePNG(frame* current){
+            std::ostringstream fileName;
+            fileName << output << std::setw(5) << std::setfill('0') << current->index << ".png";
+
+            if(PNGEncoder::write(fileName.str(), reinterpret_cast<const uint8_t*>(current->pixels.data()), current->width, current->height)) written++;
+            else hasFailed = true;
+
+            release(current);
+        }
+
+        //Writes the frame and all frames after it that are ready, unless another thread is already writing
+        void writeRaw(frame* current){
+            {
+                std::lock_guard<std::mutex> lock(writeMutex);
+                waitingFrames[current->index] = current;
+
+                if(isWriting) return;
+
+                isWriting = true;
+            }
+
+            while(true){
+                frame* next;
+
+                {
+                    std::lock_guard<std::mutex> lock(writeMutex);
+                    auto found = waitingFrames.find(nextToWrite);
+
+                    if(found == waitingFrames.end()){
+                        isWriting = false;
+
+                        return;
+                    }
+
+                    next = found->second;
+                    waitingFrames.erase(found);
+                }
+
+                size_t pixelsAmount = (size_t)next->width * next->height;
+
+                //Reader that closed the pipe gives a short write (EPIPE), SIGPIPE is ignored
+
+                if(!hasFailed){
+                    if(std::fwrite(next->pixels.data(), sizeof(olc::Pixel), pixelsAmount, stream) == pixelsAmount) written++;
+                    else hasFailed = true;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(writeMutex);
+                    nextToWrite++;
+                }
+
+                release(next);
+            }
+        }
+
+    public:
+        //threadsAmount - threads encoding and writing frames, buffersAmount - frames that can exist at once
+        FrameExporter(const std::string& output, int threadsAmount, int buffersAmount) : output(output){
+            threadsAmount = std::max(threadsAmount, 1);
+            buffersAmount = std::max(buffersAmount, 1);
+
+            #if !defined(_WIN32)
+            //Writing to a closed pipe would kill the process instead of failing the write
+            if(output == "-" || (!output.empty() && output[0] == '|')) std::signal(SIGPIPE, SIG_IGN);
+            #endif
+
+            if(output == "-"){
+                isRaw = true;
+                stream = stdout;
+
+                #if defined(_WIN32)
+                _setmode(_fileno(stdout), _O_BINARY);
+                #endif
+            }
+            else if(!output.empty() && output[0] == '|'){
+                isRaw = true;
+                isPipe = true;
+
+                #if defined(_WIN32)
+                stream = _popen(output.substr(1).c_str(), "wb");
+                #else
+                stream = popen(output.substr(1).c_str(), "w");
+                #endif
+
+                if(!stream) hasFailed = true;
+            }
+
+            //Thread of the caller is counted by the scheduler, but it only helps in finish()
+            scheduler = std::make_unique<TaskScheduler>(threadsAmount + 1);
+
+            for(int i = 0; i < buffersAmount; i++){
+                frames.push_back(std::make_unique<frame>());
+                freeFrames.push_back(frames.back().get());
+            }
+        }
+
+        ~FrameExporter(){
+            finish();
+        }
+
+        FrameExporter(const FrameExporter&) = delete;
+        FrameExporter& operator=(const FrameExporter&) = delete;
+
+        //Free buffer for the next frame, blocks until one is written if there are none
+        frame* acquire(){
+            std::unique_lock<std::mutex> lock(poolMutex);
+
+            if(freeFrames.empty()){
+                auto start = std::chrono::steady_clock::now();
+
+                frameFreed.wait(lock, [this]{ return !freeFrames.empty(); });
+
+                waitTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+
+            frame* result = freeFrames.back();
+            freeFrames.pop_back();
+
+            return result;
+        }
+
+        //Frame can't be changed by the caller after that
+        void submit(frame* filled){
+            filled->index = submitted++;
+
+            if(isRaw) scheduler->submit(group, [this, filled]{ writeRaw(filled); });
+            else scheduler->submit(group, [this, filled]{ writePNG(filled); });
+        }
+
+        //Waits until all submitted frames are written, the caller helps with them meanwhile
+        void finish(){
+            scheduler->wait(group);
+
+            if(!stream) return;
+
+            if(std::fflush(stream) != 0) hasFailed = true;
+
+            if(isPipe){
+                #if defined(_WIN32)
+                int status = _pclose(stream);
+                #else
+                int status = pclose(stream);
+                #endif
+
+                //Command that failed didn't get all frames, or couldn't use them
+                if(status != 0) hasFailed = true;
+            }
+
+            stream = nullptr;
+        }
+
+        bool failed() const{
+            return hasFailed;
+        }
+
+        long getWrittenFrames() const{
+            return written;
+        }
+
+        double getWaitTime() const{
+            return waitTime;
+        }
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+//Block of memory backed by huge pages when the system allows it
+//Large grids walked row by row and neighbour by neighbour touch many 4 KiB pages,
+//with 2 MiB pages far fewer TLB entries are needed to cover them
+//Memory is returned zeroed
+class HugePageBuffer{
+    public:
+        enum pageModes {pages_normal, pages_transparent, pages_explicit};
+
+    private:
+        void* memory = nullptr;
+        size_t size = 0;
+        //Describes what was actually obtained, used for the startup log
+        std::string description = "none";
+
+        //0 - munmap, 1 - VirtualFree, 2 - free
+        int releaseMethod = 0;
+
+        static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+        static size_t roundUp(size_t value, size_t alignment){
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        void release(){
+            if(!memory) return;
+
+            #if defined(_WIN32)
+            if(releaseMethod == 1) VirtualFree(memory, 0, MEM_RELEASE);
+            #elif defined(__linux__)
+            if(releaseMethod == 0) munmap(memory, size);
+            #endif
+
+            if(releaseMethod == 2) std::free(memory);
+
+            memory = nullptr;
+            size = 0;
+            description = "none";
+        }
+
+        #if defined(__linux__)
+        static bool isTransparentHugePagesEnabled(){
+            std::ifstream settings("/sys/kernel/mm/transparent_hugepage/enabled");
+            std::string line;
+
+            std::getline(settings, line);
+
+            //Currently selected option is in brackets, like "always [madvise] never"
+            return line.find("[never]") == std::string::npos && !line.empty();
+        }
+        #endif
+
+    public:
+        HugePageBuffer(){}
+
+        HugePageBuffer(const HugePageBuffer&) = delete;
+        HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+
+        HugePageBuffer(HugePageBuffer&& other){
+            *this = std::move(other);
+        }
+
+        HugePageBuffer& operator=(HugePageBuffer&& other){
+            if(this != &other){
+                release();
+
+                std::swap(memory, other.memory);
+                std::swap(size, other.size);
+                std::swap(description, other.description);
+                std::swap(releaseMethod, other.releaseMethod);
+            }
+
+            return *this;
+        }
+
+        ~HugePageBuffer(){
+            release();
+        }
+
+        //Tries given mode first and falls back to the next weaker one (explicit -> transparent -> normal)
+        //Returns false only if no memory could be allocated at all
+        bool allocate(size_t bytes, pageModes mode){
+            release();
+
+            if(bytes == 0) return true;
+
+            #if defined(_WIN32)
+            if(mode == pages_explicit){
+                //Requires "Lock pages in memory" privilege
+                size_t largePage = GetLargePageMinimum();
+
+                if(largePage){
+                    size_t rounded = roundUp(bytes, largePage);
+                    memory = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+
+                    if(memory){
+                        size = rounded;
+                        releaseMethod = 1;
+                        description = "large pages";
+
+                        return true;
+                    }
+                }
+            }
+
+            memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+            if(memory){
+                size = bytes;
+                releaseMethod = 1;
+                description = "4 KiB pages";
+
+                return true;
+            }
+            #elif defined(__linux__)
+            if(mode == pages_explicit){
+                //Only works when pages were reserved in /proc/sys/vm/nr_hugepages
+                size_t rounded = roundUp(bytes, hugePageSize);
+                void* mapped = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+                if(mapped != MAP_FAILED){
+                    memory = mapped;
+                    size = rounded;
+                    releaseMethod = 0;
+                    description = "explicit 2 MiB huge pages (hugetlbfs)";
+
+                    return true;
+                }
+            }
+
+            size_t rounded = roundUp(bytes, hugePageSize);
+            void* mapped = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if(mapped != MAP_FAILED){
+                memory = mapped;
+                size = rounded;
+                releaseMethod = 0;
+                description = "4 KiB pages";
+
+                if(mode != pages_normal && isTransparentHugePagesEnabled() && madvise(mapped, rounded, MADV_HUGEPAGE) == 0){
+                    description = "transparent 2 MiB huge pages (madvise)";
+                }
+
+                return true;
+            }
+            #endif
+
+            memory = std::calloc(1, bytes);
+
+            if(memory){
+                size = bytes;
+                releaseMethod = 2;
+                description = "malloc";
+
+                return true;
+            }
+
+            return false;
+        }
+
+        //Gives pages back to the system without unmapping them, next access to them reads zeros
+        //Much cheaper than writing zeros to big buffers, but pages are placed again
+        //by the thread that touches them first. Returns false if it's not supported for this buffer
+        bool dropPages(){
+            if(!memory) return true;
+
+            #if defined(__linux__)
+            if(releaseMethod == 0) return madvise(memory, size, MADV_DONTNEED) == 0;
+            #endif
+
+            return false;
+        }
+
+        void* data() const{
+            return memory;
+        }
+
+        size_t bytes() const{
+            return size;
+        }
+
+        const std::string& pagesDescription() const{
+            return description;
+        }
+};
+
+//Two dimensional array stored in one HugePageBuffer, row after row
+//T has to be trivially copyable and all zero bytes have to be its default state
+template <typename T>
+class HugePageGrid{
+    private:
+        HugePageBuffer buffer;
+        T* cells = nullptr;
+        int width = 0;
+        int height = 0;
+
+    public:
+        //Previous content is lost, new cells are zeroed
+        bool allocate(int newWidth, int newHeight, HugePageBuffer::pageModes mode){
+            width = newWidth;
+            height = newHeight;
+
+            bool isAllocated = buffer.allocate(sizeof(T) * width * height, mode);
+            cells = static_cast<T*>(buffer.data());
+
+            return isAllocated;
+        }
+
+        //Memory is kept when sizes don't change, content is left as it was
+        //Returns true if the old memory was kept
+        bool reuse(int newWidth, int newHeight, HugePageBuffer::pageModes mode){
+            if(cells && newWidth == width && newHeight == height) return true;
+
+            allocate(newWidth, newHeight, mode);
+
+            return false;
+        }
+
+        //Zeroes all cells by dropping their pages, returns false if the buffer doesn't support it
+        bool dropPages(){
+            return buffer.dropPages();
+        }
+
+        T* operator[](int y){
+            return cells + (size_t)y * width;
+        }
+
+        const T* operator[](int y) const{
+            return cells + (size_t)y * width;
+        }
+
+        int getWidth() const{
+            return width;
+        }
+
+        int getHeight() const{
+            return height;
+        }
+
+        const HugePageBuffer& getBuffer() const{
+            return buffer;
+        }
+};
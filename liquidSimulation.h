@@ -0,0 +1,1497 @@
+#pragma once
+
+#include "olcPixelGameEngine.h"
+#include "nlohmann/json.hpp"
+
+#include "taskScheduler.h"
+#include "numaTopology.h"
+#include "hugePageGrid.h"
+#include "blockPool.h"
+#include "summaryPyramid.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+#define solidBlockID 999
+
+//Makes the calling thread flush denormal floats to zero (FTZ) and treat denormal inputs as zero (DAZ)
+//Tiny amounts of water left by repeated dividing would otherwise make every operation on them very slow
+//Has to be called on every thread that runs the simulation
+inline void enableFlushToZero(){
+    #if defined(__SSE__) || defined(_M_X64)
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    #endif
+}
+
+//Cellular automaton of liquid, without window and user input
+//LiquidSimulator shows it and lets the user edit it, but it can also run on its own (like in EnsembleRunner)
+class LiquidSimulation{
+    public:
+        struct statistics{
+            //Water in cells and lakes
+            double water;
+            //Part of it in lakes
+            double lakeWater;
+            //Water removed because it was too little to keep (see massEpsilon)
+            double removedMass;
+            //Cells with water that are simulated one by one
+            int liquidCells;
+            int lakeCells;
+            int lakes;
+        };
+
+    protected:
+        //Set in create()
+        olc::vi2d matrixSize;
+
+        struct cell{
+            float value;
+
+            //Amount of water that went in and out of the cell since its last update
+            //Water passing through counts even if the value doesn't change, so streams never settle
+            float flow;
+            //Number of steps in a row in which flow stayed below settleFlow
+            unsigned short quietSteps;
+            //Index + 1 of the lake the cell belongs to, 0 if it's simulated on its own
+            int lake;
+
+            cell(float value) : value(value), flow(0), quietSteps(0), lake(0){}
+        };
+
+        //Connected region of settled water that is not simulated cell by cell
+        //Water flowing in or out only changes its level, cells are updated
+        //when the lake wakes up
+        //Lakes come and go as water settles and gets disturbed, so their cells are kept in blocks from blockPool
+        struct lake{
+            PooledList<olc::vi2d> cells;
+            //Cells without water of the same lake above them
+            PooledList<olc::vi2d> surface;
+            //How much the surface rose (or sank) since the lake was formed
+            float level;
+            //Level already counted in summaries
+            float summarizedLevel;
+            //Level at the last search for lakes
+            float scannedLevel;
+
+            lake(BlockPool* pool) : cells(pool), surface(pool), level(0), summarizedLevel(0), scannedLevel(0){}
+
+            bool isAlive() const{
+                return !cells.empty();
+            }
+        };
+
+        //Main matrix used for calculation
+        HugePageGrid<cell> matrix;
+        //"none", "transparent" or "explicit" (reserved hugetlbfs pages), falls back to weaker ones
+        std::string hugePages = "transparent";
+        //On reset, matrices of at least that many MiB are zeroed by dropping their pages
+        int dropPagesSize = 64;
+
+        //---Cell masks---
+        //One bit per cell, 64 cells per word, kept in sync with matrix values
+        //so the simulation step can jump straight to cells holding liquid
+        int maskWords;
+        std::vector<std::vector<uint64_t>> solidMask;
+        std::vector<std::vector<uint64_t>> liquidMask;
+        //Cells belonging to settled lakes, skipped by the simulation step
+        std::vector<std::vector<uint64_t>> lakeMask;
+        //Cells water fell through since the last clearFalling(), used only for drawing
+        //Kept as bits, so all marks are cleared at once, whichever part of the matrix was drawn
+        std::vector<std::vector<uint64_t>> fallingMask;
+        //------
+
+        //---Threads---
+        //Band of rows updated by one task
+        //Stripes of the same parity are never next to each other, so they can be updated at the same time
+        struct stripe{
+            int top;
+            //First row below the stripe
+            int bottom;
+
+            //Lakes and removedMass are shared by all stripes, so their changes
+            //are gathered here and applied after all stripes are done
+            //Written by the thread updating the stripe, in blocks from blockPool
+            PooledList<std::pair<int, float>> lakeInflow;
+            double removedMass;
+            //Lakes next to cells that ran out of water, woken after all stripes are done
+            //Like the other buffers refilled every step or scan (threadBusy, lakeVisited, lakeFlow),
+            //it's kept as a member, so memory is only allocated when it grows
+            std::vector<int> lakesToWake;
+
+            //Measured in the last step, used for load balancing statistics
+            bool isActive;
+            float time;
+            int thread;
+            //Highest flow of a cell in the last step, used for steady state detection
+            float maxFlow;
+
+            stripe(int top, int bottom, BlockPool* pool) : top(top), bottom(bottom), lakeInflow(pool), removedMass(0), isActive(false), time(0), thread(0), maxFlow(0){}
+        };
+
+        //Fixed size blocks for lists that are often built and thrown away during the simulation
+        //Declared before everything that keeps such lists, so it's destroyed after them
+        std::unique_ptr<BlockPool> blockPool;
+        size_t poolBlockSize = 256;
+
+        std::vector<stripe> stripes;
+        //Has to be at least 2, so stripes updated together never touch the same row
+        int stripeHeight = 8;
+
+        //---Load balancing---
+        //Moves stripe boundaries so every stripe takes about the same time to update
+        bool balanceStripes = true;
+        int rebalanceInterval = 30;
+        int stepsSinceRebalance = 0;
+        //Number of stripes aimed for each thread in each of two phases
+        int stripesPerThread = 4;
+        //Boundaries are moved only when the most expensive stripe costs that many times more than it should
+        //Every move changes the order in which cells are updated and stirs settled water a bit
+        float rebalanceTolerance = 1.5;
+        //Not worth moving boundaries when the whole step takes less (milliseconds)
+        float minRebalanceCost = 0.05;
+        //Averaged time of updating every row (milliseconds)
+        std::vector<float> rowCost;
+        //Weight of the newest measurement in the averages (also used for auto steps)
+        float timeSmoothing = 0.1;
+        //Time every thread spent on stripes of one parity, summed by measureImbalance()
+        std::vector<float> threadBusy;
+        //------
+
+        //0 means as many as hardware supports
+        int threadsAmount = 0;
+        std::unique_ptr<TaskScheduler> scheduler;
+
+        //"none", "cores" (thread per CPU) or "nodes" (thread restricted to CPUs of a NUMA node)
+        std::string pinThreads = "none";
+        //------
+
+        //---Settled lakes---
+        std::vector<lake> lakes;
+        //Cells already visited by the current scan of findLakes()
+        std::vector<std::vector<bool>> lakeVisited;
+
+        //Flow per step below which a cell is considered settled
+        float settleFlow = 0.001;
+        //Steps a cell has to stay settled before it can become part of a lake
+        unsigned short settleSteps = 120;
+        //Steps between searches for new lakes
+        int lakeScanInterval = 60;
+        int stepsSinceLakeScan = 0;
+        //Smaller regions are cheap enough to be simulated normally
+        int minLakeCells = 32;
+        //Change of level (in cells) after which lake is simulated again
+        float lakeWakeLevel = 0.25;
+        //------
+
+        //---Summaries---
+        //Mass, highest pressure and solid blocks of square regions on many levels,
+        //used for zoomed out drawing. Updated only on request, see updateSummaries()
+        SummaryPyramid summaries;
+        //Chunks of summaries with water simulated cell by cell at the last update,
+        //they have to be updated again even if the water left them
+        std::vector<int> liquidChunks;
+        std::vector<char> isLiquidChunk;
+        //------
+
+        //---Steady state---
+        //Whole matrix is settled when no cell and no lake had more flow than steadyFlow for steadySteps steps in a row
+        float steadyFlow = 0.001;
+        int steadySteps = 60;
+        int quietStepsInRow = 0;
+        long stepsDone = 0;
+        //Step after which the matrix was found settled, -1 if it's still moving
+        long settledStep = -1;
+        //Net inflow of every lake in the last step
+        //Water passing back and forth between a lake and its neighbours cancels out here
+        std::vector<float> lakeFlow;
+        //------
+
+        float minFlow = 0.5;
+        char maxWaterValue = 4;
+
+        //Cells with less water than that are emptied, their water goes to a neighbour
+        //or is removed (and counted in removedMass) if there is none
+        float massEpsilon = 0.0001;
+        double removedMass = 0;
+
+        //---Parameters---
+        float compression = 0.4;
+        float flowDivider = 1;
+
+        //Levels horizontal runs of water in one sweep before every step
+        float equalizePools = 0;
+
+        //Stops simulating regions of settled water
+        float mergeLakes = 1;
+
+        //Maximal number of cells water can fall through air in one step
+        float terminalVelocity = 8;
+        //------
+
+        //---Profiler---
+        //Steps and stripes are timed only while something shows the results
+        bool isProfiled = false;
+        //Gathered since the last refresh of the profiler, which resets them
+        double profiledStepTime = 0;
+        int profiledSteps = 0;
+        double profiledBusyMax = 0;
+        double profiledBusyMean = 0;
+        //------
+
+        //First row of the block of rows that lives in memory of the given thread
+        //Rows are split evenly, in order of threads, so threads of the same NUMA node get neighbouring rows
+        int firstHomeRow(int thread){
+            return thread * matrixSize.y / scheduler->threadsAmount();
+        }
+
+        int homeThread(int row){
+            return ((row + 1) * scheduler->threadsAmount() - 1) / matrixSize.y;
+        }
+
+        //matrixSizes and scheduler have to be initialized before calling this method
+        //Also used for reset, memory of the matrix and masks is reused when sizes didn't change
+        void initializeMatrix(){
+            HugePageBuffer::pageModes pageMode = HugePageBuffer::pages_normal;
+
+            if(hugePages == "transparent") pageMode = HugePageBuffer::pages_transparent;
+            else if(hugePages == "explicit") pageMode = HugePageBuffer::pages_explicit;
+
+            bool isReused = matrix.reuse(matrixSize.x, matrixSize.y, pageMode);
+
+            //Dropping pages of a big matrix is much cheaper than writing zeros to it,
+            //but pages would be placed by whichever thread touches them first,
+            //so it's not used when threads are placed on NUMA nodes
+            bool isZeroed = isReused && pinThreads == "none"
+                && matrix.getBuffer().bytes() >= (size_t)dropPagesSize * 1024 * 1024 && matrix.dropPages();
+
+            if(!isZeroed){
+                //Every row is allocated and filled by its home thread, so its memory
+                //is placed on the NUMA node of that thread (first touch)
+                //With huge pages the whole 2 MiB page goes to the node of the thread that touches it first,
+                //so rows around the border of two blocks can live on the node of the neighbouring thread
+                TaskScheduler::taskGroup group;
+
+                for(int thread = 0; thread < scheduler->threadsAmount(); thread++){
+                    scheduler->submitPinned(group, [this, thread]{
+                        for(int y = firstHomeRow(thread); y < firstHomeRow(thread + 1); y++){
+                            //Filling everything with 0
+                            std::fill(matrix[y], matrix[y] + matrixSize.x, cell(0));
+                        }
+                    }, thread);
+                }
+
+                scheduler->wait(group);
+            }
+
+            //Empty matrix means empty masks
+            maskWords = (matrixSize.x + 63) / 64;
+
+            if(isReused){
+                for(int y = 0; y < matrixSize.y; y++){
+                    std::fill(solidMask[y].begin(), solidMask[y].end(), 0);
+                    std::fill(liquidMask[y].begin(), liquidMask[y].end(), 0);
+                    std::fill(lakeMask[y].begin(), lakeMask[y].end(), 0);
+                    std::fill(fallingMask[y].begin(), fallingMask[y].end(), 0);
+                    std::fill(lakeVisited[y].begin(), lakeVisited[y].end(), false);
+                }
+
+                std::fill(rowCost.begin(), rowCost.end(), 0);
+            }
+            else{
+                solidMask.assign(matrixSize.y, std::vector<uint64_t>(maskWords, 0));
+                liquidMask.assign(matrixSize.y, std::vector<uint64_t>(maskWords, 0));
+                lakeMask.assign(matrixSize.y, std::vector<uint64_t>(maskWords, 0));
+                fallingMask.assign(matrixSize.y, std::vector<uint64_t>(maskWords, 0));
+                lakeVisited.assign(matrixSize.y, std::vector<bool>(matrixSize.x, false));
+                rowCost.assign(matrixSize.y, 0);
+            }
+
+            lakes.clear();
+            stepsSinceLakeScan = 0;
+            removedMass = 0;
+
+            quietStepsInRow = 0;
+            stepsDone = 0;
+            settledStep = -1;
+
+            summaries.create(matrixSize.x, matrixSize.y);
+            liquidChunks.clear();
+            isLiquidChunk.assign((size_t)summaries.levelWidth(summaries.getChunkLevel()) * summaries.levelHeight(summaries.getChunkLevel()), false);
+
+            //Layout measured for the previous content means nothing for the empty one
+            stripes.clear();
+
+            for(int top = 0; top < matrixSize.y; top += stripeHeight){
+                stripes.push_back(stripe(top, std::min(top + stripeHeight, matrixSize.y), blockPool.get()));
+            }
+
+            stepsSinceRebalance = 0;
+        }
+
+        //Sets solid and liquid bits of the cell according to its current value
+        //Has to be called after every change of matrix value
+        void updateMasks(int x, int y){
+            uint64_t bit = uint64_t(1) << (x & 63);
+            float value = matrix[y][x].value;
+
+            if(value == solidBlockID) solidMask[y][x >> 6] |= bit;
+            else solidMask[y][x >> 6] &= ~bit;
+
+            if(value > 0 && value != solidBlockID) liquidMask[y][x >> 6] |= bit;
+            else liquidMask[y][x >> 6] &= ~bit;
+        }
+
+        //Returns neighour of currentPosition, defined by versor
+        //Returns -1 if out of range
+        float getNeighbour(olc::vi2d currentPosition, olc::vi2d versor){
+            int positionX = currentPosition.x + versor.x;
+            int positionY = currentPosition.y + versor.y;
+
+            if(positionX < matrixSize.x && positionY < matrixSize.y && positionX >= 0 && positionY >= 0){
+                return matrix[positionY][positionX].value;
+            }
+            else{
+                return -1;
+            }
+        }
+
+        //Returns amount of water that should flow from source to sink
+        float waterFlowDown(float source, float sink){
+            float sum = source + sink;
+
+            //If all water from source will fit in the sink
+            if(sum <= maxWaterValue){
+                return source;
+            }
+            //If not all water from source will fit in the sink and source wouldn't be full
+            //It means that bottom cell will become compressed but only proportionally to the amount of water above
+            else if(sum < (2 * maxWaterValue + compression)){
+                return (maxWaterValue * maxWaterValue + sum * compression) / (maxWaterValue + compression) - sink;
+            }
+            else{
+                return ((sum + compression) / 2) - sink;
+            }
+        }
+
+        float waterFlowUp(float source, float sink){
+            return source - (waterFlowDown(source, sink) + sink);
+        }
+
+        //Value of the cell as its neighbours see it: water that flowed in or out of a lake
+        //isn't in its cells yet, so it's added to its surface, like in cellSummary()
+        //Lakes that lost water give less and lakes that got water give more, so water between them levels out
+        float neighbourValue(int x, int y){
+            const cell& neighbour = matrix[y][x];
+
+            if(!neighbour.lake || (y > 0 && matrix[y - 1][x].lake == neighbour.lake)) return neighbour.value;
+
+            return neighbour.value + lakes[neighbour.lake - 1].level;
+        }
+
+        //Changes level of the lake by given amount of water, doesn't touch its cells
+        void addToLake(int lakeID, float amount){
+            lake& currentLake = lakes[lakeID - 1];
+
+            currentLake.level += amount / currentLake.surface.size();
+        }
+
+        //Turns lake back into normally simulated cells
+        //Water that flowed in is added to the surface, water that flowed out
+        //is taken from all cells in proportion to their value
+        void wakeLake(int lakeID){
+            lake& currentLake = lakes[lakeID - 1];
+
+            if(currentLake.level >= 0){
+                for(olc::vi2d& position : currentLake.surface){
+                    matrix[position.y][position.x].value += currentLake.level;
+                }
+            }
+            else{
+                float sum = 0;
+
+                for(olc::vi2d& position : currentLake.cells){
+                    sum += matrix[position.y][position.x].value;
+                }
+
+                float remaining = sum + currentLake.level * currentLake.surface.size();
+                float factor = remaining > 0 ? remaining / sum : 0;
+
+                for(olc::vi2d& position : currentLake.cells){
+                    matrix[position.y][position.x].value *= factor;
+                }
+            }
+
+            for(olc::vi2d& position : currentLake.cells){
+                cell& currentCell = matrix[position.y][position.x];
+
+                currentCell.lake = 0;
+                currentCell.quietSteps = 0;
+
+                lakeMask[position.y][position.x >> 6] &= ~(uint64_t(1) << (position.x & 63));
+                updateMasks(position.x, position.y);
+            }
+
+            currentLake.cells.clear(scheduler->threadIndex());
+            currentLake.surface.clear(scheduler->threadIndex());
+        }
+
+        //Wakes lakes that the cell or its neighbours belong to
+        //Has to be called before the cell is changed by the user
+        void wakeLakesAround(int x, int y){
+            //Changed cell can start moving water again
+            disturb();
+            summaries.markCell(x, y);
+
+            const olc::vi2d versors[5] = {{0, 0}, {0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+
+            for(const olc::vi2d& versor : versors){
+                int positionX = x + versor.x;
+                int positionY = y + versor.y;
+
+                if(getNeighbour({positionX, positionY}, {0, 0}) == -1) continue;
+
+                int lakeID = matrix[positionY][positionX].lake;
+
+                if(lakeID) wakeLake(lakeID);
+            }
+        }
+
+        //Spreads water of the lake across its cells the way it rests: cells of a row hold the same amount
+        //and every row holds compression more than the one above it (both cells full, see waterFlowDown())
+        //Cells of a lake keep the values they had when it formed, and even tiny differences from that
+        //would keep water going round through the cells next to it, in at one place and out at another
+        void levelLake(lake& currentLake){
+            int top = matrixSize.y;
+            double water = 0;
+
+            for(olc::vi2d& position : currentLake.cells){
+                top = std::min(top, position.y);
+                water += matrix[position.y][position.x].value;
+            }
+
+            //Water is the number of cells times the value of the top row, plus compression for every row below it
+            double depths = 0;
+
+            for(olc::vi2d& position : currentLake.cells){
+                depths += position.y - top;
+            }
+
+            double topValue = (water - depths * compression) / currentLake.cells.size();
+
+            for(olc::vi2d& position : currentLake.cells){
+                matrix[position.y][position.x].value = topValue + (position.y - top) * compression;
+                summaries.markCell(position.x, position.y);
+            }
+        }
+
+        //Flood fills regions of cells that stayed settled for settleSteps
+        //and turns big enough ones into lakes
+        //Lakes touching a region become part of it. Lakes frozen at different times differ a little,
+        //which would keep water going from one to the other through the cells between them
+        void findLakes(){
+            std::vector<olc::vi2d> stack;
+            std::vector<olc::vi2d> region;
+            std::vector<int> joinedLakes;
+            std::vector<std::vector<bool>>& visited = lakeVisited;
+
+            for(std::vector<bool>& row : visited){
+                std::fill(row.begin(), row.end(), false);
+            }
+
+            auto isSettled = [&](int x, int y){
+                const cell& currentCell = matrix[y][x];
+
+                //Flow counts water passing through, so falling streams and through-flow are never settled
+                //Cells that aren't full stay out of lakes. Water resting on a full cell is very sensitive to its value
+                //(a change of it is about ten times bigger above), so a frozen cell that is a tiny bit off
+                //would keep the surface above it moving forever. Free surface follows the lake instead
+                return currentCell.value >= maxWaterValue && currentCell.value != solidBlockID && !currentCell.lake
+                    && currentCell.quietSteps >= settleSteps;
+            };
+
+            auto canJoin = [&](int x, int y){
+                return matrix[y][x].lake || isSettled(x, y);
+            };
+
+            for(int y = 0; y < matrixSize.y; y++){
+                for(int x = 0; x < matrixSize.x; x++){
+                    if(visited[y][x] || !isSettled(x, y)) continue;
+
+                    region.clear();
+                    joinedLakes.clear();
+                    stack.push_back({x, y});
+                    visited[y][x] = true;
+
+                    while(!stack.empty()){
+                        olc::vi2d position = stack.back();
+                        stack.pop_back();
+                        region.push_back(position);
+
+                        int joinedLake = matrix[position.y][position.x].lake;
+
+                        if(joinedLake && std::find(joinedLakes.begin(), joinedLakes.end(), joinedLake) == joinedLakes.end()){
+                            joinedLakes.push_back(joinedLake);
+                        }
+
+                        const olc::vi2d versors[4] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+
+                        for(const olc::vi2d& versor : versors){
+                            olc::vi2d next = position + versor;
+
+                            if(getNeighbour(next, {0, 0}) == -1 || visited[next.y][next.x] || !canJoin(next.x, next.y)) continue;
+
+                            visited[next.y][next.x] = true;
+                            stack.push_back(next);
+                        }
+                    }
+
+                    if((int)region.size() < minLakeCells) continue;
+
+                    //Water that flowed in or out of joined lakes goes to their cells first
+                    for(int joinedLake : joinedLakes){
+                        wakeLake(joinedLake);
+                    }
+
+                    //Reusing slots of lakes that woke up
+                    int lakeID = 0;
+
+                    for(int i = 0; i < (int)lakes.size(); i++){
+                        if(!lakes[i].isAlive()){
+                            lakeID = i + 1;
+                            break;
+                        }
+                    }
+
+                    if(!lakeID){
+                        lakes.push_back(lake(blockPool.get()));
+                        lakeID = lakes.size();
+                    }
+
+                    lake& newLake = lakes[lakeID - 1];
+                    newLake.level = 0;
+                    newLake.summarizedLevel = 0;
+                    newLake.scannedLevel = 0;
+
+                    //Lists are filled before any cell is marked, so a lake that doesn't fit in the pool
+                    //is dropped without leaving cells that nothing would wake up
+                    //Cells are visited only when they can be in a region, so a visited cell above is in the same region
+                    //and only cells without one are on the surface
+                    bool isStored = true;
+
+                    for(olc::vi2d& position : region){
+                        isStored = isStored && newLake.cells.push_back(position, scheduler->threadIndex());
+
+                        if(position.y == 0 || !visited[position.y - 1][position.x]){
+                            isStored = isStored && newLake.surface.push_back(position, scheduler->threadIndex());
+                        }
+                    }
+
+                    if(!isStored){
+                        newLake.cells.clear(scheduler->threadIndex());
+                        newLake.surface.clear(scheduler->threadIndex());
+
+                        continue;
+                    }
+
+                    for(olc::vi2d& position : region){
+                        matrix[position.y][position.x].lake = lakeID;
+                        lakeMask[position.y][position.x >> 6] |= uint64_t(1) << (position.x & 63);
+                    }
+
+                    levelLake(newLake);
+                }
+            }
+        }
+
+        //Wakes lakes with level changed too much and looks for new ones from time to time
+        //Lake whose level stopped changing also wakes up, its surface is higher (or lower) than the water around it
+        //and can't level out while it's frozen, so water would keep going round through cells next to it
+        //It forms again once it settles
+        void updateLakes(){
+            for(int i = 0; i < (int)lakes.size(); i++){
+                if(lakes[i].isAlive() && (!mergeLakes || fabs(lakes[i].level) > lakeWakeLevel)){
+                    wakeLake(i + 1);
+                }
+            }
+
+            if(!mergeLakes) return;
+
+            stepsSinceLakeScan++;
+
+            if(stepsSinceLakeScan >= lakeScanInterval){
+                for(int i = 0; i < (int)lakes.size(); i++){
+                    lake& currentLake = lakes[i];
+
+                    if(!currentLake.isAlive()) continue;
+
+                    if(fabs(currentLake.level) > settleFlow && fabs(currentLake.level - currentLake.scannedLevel) < settleFlow){
+                        wakeLake(i + 1);
+                    }
+                    else{
+                        currentLake.scannedLevel = currentLake.level;
+                    }
+                }
+
+                findLakes();
+                stepsSinceLakeScan = 0;
+            }
+        }
+
+        //Moves water from the cell to its neighbour
+        //Lakes receive it as a change of their level, returns true if the neighbour is a lake
+        //Water given to a lake isn't added to the flow of the cell here, it's counted in simulateCell()
+        bool moveWater(int x, int y, int sinkX, int sinkY, float amount, stripe& owner){
+            matrix[y][x].value -= amount;
+
+            cell& sink = matrix[sinkY][sinkX];
+
+            //If the pool ran out of blocks, water stays in the cell of the lake, which is still counted
+            //and goes to the rest of the lake when it wakes up
+            if(sink.lake){
+                if(!owner.lakeInflow.push_back({sink.lake, amount}, owner.thread)) sink.value += amount;
+
+                return true;
+            }
+
+            matrix[y][x].flow += fabs(amount);
+            sink.value += amount;
+            sink.flow += fabs(amount);
+            updateMasks(sinkX, sinkY);
+
+            return false;
+        }
+
+        //Cells of lakes are not simulated, so water that would flow
+        //from them to the current cell is calculated here
+        //Water is taken only if the change of the lake could be stored
+        //Taken water is subtracted from lakeExchange (below, left, right, above)
+        void pullFromLakes(int x, int y, stripe& owner, float lakeExchange[4]){
+            cell& currentCell = matrix[y][x];
+
+            //---Falling from lake above---
+            if(y > 0 && matrix[y - 1][x].lake){
+                float waterToFlow = waterFlowDown(neighbourValue(x, y - 1), currentCell.value);
+
+                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                if(waterToFlow > 0 && owner.lakeInflow.push_back({matrix[y - 1][x].lake, -waterToFlow}, owner.thread)){
+                    currentCell.value += waterToFlow;
+                    lakeExchange[3] -= waterToFlow;
+                }
+            }
+            //------
+
+            //---Spilling from lakes on the sides---
+            for(int sideX = x - 1; sideX <= x + 1; sideX += 2){
+                if(sideX < 0 || sideX >= matrixSize.x || !matrix[y][sideX].lake) continue;
+
+                float sideCell = neighbourValue(sideX, y);
+
+                if(sideCell > currentCell.value){
+                    float waterToFlow = (sideCell - currentCell.value) / 4.f;
+
+                    if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                    if(!owner.lakeInflow.push_back({matrix[y][sideX].lake, -waterToFlow}, owner.thread)) continue;
+
+                    currentCell.value += waterToFlow;
+                    lakeExchange[sideX < x ? 1 : 2] -= waterToFlow;
+                }
+            }
+            //------
+
+            //---Pushed up from lake below---
+            if(y < matrixSize.y - 1 && matrix[y + 1][x].lake){
+                float waterToFlow = waterFlowUp(neighbourValue(x, y + 1), currentCell.value);
+
+                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                if(waterToFlow > 0 && owner.lakeInflow.push_back({matrix[y + 1][x].lake, -waterToFlow}, owner.thread)){
+                    currentCell.value += waterToFlow;
+                    lakeExchange[0] -= waterToFlow;
+                }
+            }
+            //------
+        }
+
+        //Returns the lowest cell water from (x, y) can reach in one step when falling through air
+        //It's either the last empty cell above an obstacle, the cell terminalVelocity below
+        //or maxY, so water doesn't reach rows updated by other threads
+        int findFallEnd(int x, int y, int maxY){
+            int fallY = y + 1;
+
+            while(fallY - y < (int)terminalVelocity && fallY < maxY && fallY + 1 < matrixSize.y){
+                const cell& nextCell = matrix[fallY + 1][x];
+
+                if(nextCell.value != 0 || nextCell.lake) break;
+
+                fallY++;
+            }
+
+            return fallY;
+        }
+
+        //Gives remains of water in the cell to a neighbour holding water, preferably the one below
+        //If there is no such neighbour water is removed and added to removedMass
+        void cleanUpCell(int x, int y, stripe& owner){
+            float& currentCell = matrix[y][x].value;
+
+            if(currentCell == 0) return;
+
+            if(currentCell > 0){
+                const olc::vi2d versors[4] = {{0, 1}, {-1, 0}, {1, 0}, {0, -1}};
+
+                for(const olc::vi2d& versor : versors){
+                    float neighbour = getNeighbour({x, y}, versor);
+
+                    if(neighbour > 0 && neighbour != solidBlockID){
+                        moveWater(x, y, x + versor.x, y + versor.y, currentCell, owner);
+                        currentCell = 0;
+
+                        return;
+                    }
+                }
+            }
+
+            owner.removedMass += currentCell;
+            currentCell = 0;
+        }
+
+        //Calculates flow of water from the cell to its neighbours
+        void simulateCell(int x, int y, stripe& owner){
+            float& currentCell = matrix[y][x].value;
+
+            //---Settling---
+            //Flow gathered since the last update covers exactly one step
+            owner.maxFlow = std::max(owner.maxFlow, matrix[y][x].flow);
+
+            if(matrix[y][x].flow < settleFlow){
+                if(matrix[y][x].quietSteps < settleSteps) matrix[y][x].quietSteps++;
+            }
+            else{
+                matrix[y][x].quietSteps = 0;
+            }
+
+            matrix[y][x].flow = 0;
+            //------
+
+            //---Values of current cell neighbours---
+            float upperCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(0, -1));
+            float bottomCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(0, 1));
+            float leftCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(-1, 0));
+            float rightCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(1, 0));
+
+            if(upperCell > 0 && matrix[y - 1][x].lake) upperCell = neighbourValue(x, y - 1);
+            if(bottomCell > 0 && matrix[y + 1][x].lake) bottomCell = neighbourValue(x, y + 1);
+            if(leftCell > 0 && matrix[y][x - 1].lake) leftCell = neighbourValue(x - 1, y);
+            if(rightCell > 0 && matrix[y][x + 1].lake) rightCell = neighbourValue(x + 1, y);
+            //------
+
+            //Water given to neighbours below, on the left, on the right and above that are lakes (negative if taken)
+            float lakeExchange[4] = {0, 0, 0, 0};
+
+            //---Falling down---
+            if(currentCell > 0 && bottomCell != -1 && bottomCell != solidBlockID){
+                float waterToFlow = waterFlowDown(currentCell, bottomCell);
+
+                //Instead of instant transfering water
+                //we do it partialy to create smooth transition
+                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                //Water falling into air goes straight to the end of the free fall
+                int fallY = y + 1;
+
+                if(bottomCell == 0) fallY = findFallEnd(x, y, owner.bottom);
+
+                if(moveWater(x, y, x, fallY, waterToFlow, owner)) lakeExchange[0] += waterToFlow;
+
+                //Whole column is marked, so the stream is still rendered as continuous
+                if(waterToFlow > 0.1){
+                    for(int i = y + 1; i <= fallY; i++){
+                        fallingMask[i][x >> 6] |= uint64_t(1) << (x & 63);
+                    }
+                }
+            }
+
+            //---Spilling to left---
+            if(currentCell > 0 && leftCell != -1 && leftCell != solidBlockID){
+                if(leftCell < currentCell){
+
+                    float waterToFlow = (currentCell - leftCell) / 4.f;
+
+                    //Instead of instant transfering water
+                    //we do it partialy to create smooth transition
+                    if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                    if(moveWater(x, y, x - 1, y, waterToFlow, owner)) lakeExchange[1] += waterToFlow;
+                }     
+            }
+            //------
+
+            //---Spilling to right---
+            if(currentCell > 0 && rightCell != -1 && rightCell != solidBlockID){
+                if(rightCell < currentCell){
+
+                    float waterToFlow = (currentCell - rightCell) / 4.f;
+                    if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+                    
+                    if(moveWater(x, y, x + 1, y, waterToFlow, owner)) lakeExchange[2] += waterToFlow;
+                }
+            }
+            //------
+
+            //---Going up---
+            if(currentCell > 0 && upperCell != -1 && upperCell != solidBlockID){
+
+                float waterToFlow = waterFlowUp(currentCell, upperCell);
+
+                //Instead of instant transfering water
+                //we do it partialy to create smooth transition
+                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+
+                //Rounding makes it slightly negative when nothing should flow, which would leave
+                //a negative value in the empty cell above, where it's never simulated nor cleaned up
+                if(waterToFlow > 0 && moveWater(x, y, x, y - 1, waterToFlow, owner)) lakeExchange[3] += waterToFlow;
+            }
+            //------
+
+            pullFromLakes(x, y, owner, lakeExchange);
+
+            //---Exchange with lakes---
+            //Only the net amount given to or taken from every lake counts as flow. Cells of lakes don't change,
+            //so a cell in or next to a lake can pass the same water in and out of it every step without moving anything
+            const olc::vi2d faces[4] = {{0, 1}, {-1, 0}, {1, 0}, {0, -1}};
+
+            for(int i = 0; i < 4; i++){
+                if(lakeExchange[i] == 0) continue;
+
+                int lakeID = matrix[y + faces[i].y][x + faces[i].x].lake;
+                float netAmount = lakeExchange[i];
+
+                for(int j = i + 1; j < 4; j++){
+                    if(lakeExchange[j] != 0 && matrix[y + faces[j].y][x + faces[j].x].lake == lakeID){
+                        netAmount += lakeExchange[j];
+                        lakeExchange[j] = 0;
+                    }
+                }
+
+                matrix[y][x].flow += fabs(netAmount);
+            }
+            //------
+
+            if(currentCell < massEpsilon) cleanUpCell(x, y, owner);
+
+            //---Emptied next to a lake---
+            //Empty cell isn't updated any more, so lakes next to it would never give it water again
+            //They are woken up after the step instead, their cells can be in other stripes
+            if(currentCell == 0){
+                const olc::vi2d versors[4] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+
+                for(const olc::vi2d& versor : versors){
+                    if(getNeighbour({x, y}, versor) == -1) continue;
+
+                    int lakeID = matrix[y + versor.y][x + versor.x].lake;
+
+                    if(lakeID) owner.lakesToWake.push_back(lakeID);
+                }
+            }
+            //------
+
+            updateMasks(x, y);
+        }
+
+        //Cell lies on top of something that holds it in place
+        bool isSupported(int x, int y){
+            if(y == matrixSize.y - 1) return true;
+
+            float bottomCell = matrix[y + 1][x].value;
+
+            return bottomCell == solidBlockID || bottomCell >= maxWaterValue;
+        }
+
+        //Finds horizontal runs of supported water closed by solids (or matrix edges) on both sides
+        //and spreads the mass of every run evenly across it, so wide pools level out in one step
+        //instead of moving water one cell per step. Sum of every run stays the same
+        void equalizeRows(int top, int bottom){
+            for(int y = top; y < bottom; y++){
+                int x = 0;
+
+                while(x < matrixSize.x){
+                    //Run can only start at the left edge or right after a solid block
+                    if(matrix[y][x].value == solidBlockID){
+                        x++;
+                        continue;
+                    }
+
+                    int start = x;
+                    float sum = 0;
+
+                    while(x < matrixSize.x && matrix[y][x].value > 0 && matrix[y][x].value != solidBlockID && !matrix[y][x].lake && isSupported(x, y)){
+                        sum += matrix[y][x].value;
+                        x++;
+                    }
+
+                    bool closed = x == matrixSize.x || matrix[y][x].value == solidBlockID;
+
+                    //Runs ending at air or falling water are left for the regular flow
+                    if(closed && x - start > 1){
+                        float level = sum / (x - start);
+
+                        //Every cell of the run already holds water, so masks stay the same
+                        //Water moved here counts as flow, so a pool that is still levelling out isn't settled
+                        for(int i = start; i < x; i++){
+                            matrix[y][i].flow += fabs(level - matrix[y][i].value);
+                            matrix[y][i].value = level;
+                        }
+                    }
+
+                    //Skipping the rest of an open run up to the next solid block
+                    while(x < matrixSize.x && matrix[y][x].value != solidBlockID){
+                        x++;
+                    }
+                }
+            }
+        }
+
+        //Stripe has water that is not part of a lake
+        bool isStripeActive(const stripe& currentStripe){
+            for(int y = currentStripe.top; y < currentStripe.bottom; y++){
+                for(int word = 0; word < maskWords; word++){
+                    if(liquidMask[y][word] & ~lakeMask[y][word]) return true;
+                }
+            }
+
+            return false;
+        }
+
+        //Updates cells of the stripe, from bottom right to top left
+        //Only cells marked in liquidMask are visited, so words that are
+        //completely empty, completely solid or inside a lake cost a single comparison
+        void simulateStripe(stripe& currentStripe){
+            //Costs of rows are needed only to move boundaries and to show the imbalance
+            bool isTimed = balanceStripes || isProfiled;
+            auto rowStart = isTimed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+
+            currentStripe.time = 0;
+            currentStripe.thread = scheduler->threadIndex();
+
+            if(equalizePools) equalizeRows(currentStripe.top, currentStripe.bottom);
+
+            for(int y = currentStripe.bottom - 1; y >= currentStripe.top; y--){
+                for(int word = maskWords - 1; word >= 0; word--){
+                    uint64_t bits = liquidMask[y][word] & ~lakeMask[y][word];
+
+                    while(bits){
+                        //Highest set bit is the rightmost liquid cell left in this word
+                        int bit = 63 - __builtin_clzll(bits);
+
+                        simulateCell(word * 64 + bit, y, currentStripe);
+
+                        //Mask is read again, because water could have spilled to the left
+                        bits = liquidMask[y][word] & ~lakeMask[y][word] & ((uint64_t(1) << bit) - 1);
+                    }
+                }
+
+                if(!isTimed) continue;
+
+                auto rowEnd = std::chrono::steady_clock::now();
+                float time = std::chrono::duration<float, std::milli>(rowEnd - rowStart).count();
+
+                rowCost[y] += (time - rowCost[y]) * timeSmoothing;
+                currentStripe.time += time;
+                rowStart = rowEnd;
+            }
+        }
+
+        //Places stripe boundaries so every stripe has about the same averaged cost
+        //Rows without water cost nothing, so they end up in few long stripes
+        void rebalanceStripes(){
+            float totalCost = 0;
+
+            for(float cost : rowCost){
+                totalCost += cost;
+            }
+
+            int stripesAmount = std::min(scheduler->threadsAmount() * stripesPerThread * 2, matrixSize.y / 2);
+
+            if(totalCost < minRebalanceCost || stripesAmount < 2) return;
+
+            float targetCost = totalCost / stripesAmount;
+            float maxCost = 0;
+
+            for(const stripe& currentStripe : stripes){
+                float cost = 0;
+
+                for(int y = currentStripe.top; y < currentStripe.bottom; y++){
+                    cost += rowCost[y];
+                }
+
+                maxCost = std::max(maxCost, cost);
+            }
+
+            if(maxCost <= targetCost * rebalanceTolerance) return;
+
+            std::vector<stripe> newStripes;
+            int top = 0;
+            float cost = 0;
+
+            for(int y = 0; y < matrixSize.y; y++){
+                cost += rowCost[y];
+
+                bool isLast = y == matrixSize.y - 1;
+                //Both this stripe and the rest of the matrix have to be at least 2 rows high
+                bool canSplit = y + 1 - top >= 2 && matrixSize.y - (y + 1) >= 2;
+
+                if(isLast || (canSplit && cost >= targetCost)){
+                    newStripes.push_back(stripe(top, y + 1, blockPool.get()));
+
+                    top = y + 1;
+                    cost = 0;
+                }
+            }
+
+            stripes = std::move(newStripes);
+        }
+
+        //Time the busiest thread spent on stripes of the given parity divided by the average time of all threads
+        //1 means that work was split perfectly, so no thread waited for the others
+        void measureImbalance(int parity){
+            std::vector<float>& busy = threadBusy;
+            busy.assign(scheduler->threadsAmount(), 0);
+
+            for(int i = parity; i < (int)stripes.size(); i += 2){
+                if(stripes[i].isActive) busy[stripes[i].thread] += stripes[i].time;
+            }
+
+            float sum = 0;
+            float maximum = 0;
+
+            for(float time : busy){
+                sum += time;
+                maximum = std::max(maximum, time);
+            }
+
+            profiledBusyMax += maximum;
+            profiledBusyMean += sum / busy.size();
+        }
+
+        //One iteration over all cells
+        //Even stripes are updated in parallel first, then odd ones
+        //With a single thread stripes are updated directly, without queuing tasks
+        void simulationStep(){
+            auto stepStart = isProfiled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            bool isInline = scheduler->threadsAmount() == 1;
+
+            for(int parity = 0; parity < 2; parity++){
+                TaskScheduler::taskGroup group;
+
+                for(int i = parity; i < (int)stripes.size(); i += 2){
+                    stripes[i].isActive = isStripeActive(stripes[i]);
+                    stripes[i].maxFlow = 0;
+
+                    if(!stripes[i].isActive){
+                        //Rows without water stop counting towards stripe costs
+                        for(int y = stripes[i].top; y < stripes[i].bottom; y++){
+                            rowCost[y] *= 1 - timeSmoothing;
+                        }
+
+                        continue;
+                    }
+
+                    if(isInline){
+                        simulateStripe(stripes[i]);
+                        continue;
+                    }
+
+                    //Stripe is queued on the thread that owns memory of its middle row
+                    int middleRow = (stripes[i].top + stripes[i].bottom) / 2;
+
+                    scheduler->submit(group, [this, i]{ simulateStripe(stripes[i]); }, homeThread(middleRow));
+                }
+
+                scheduler->wait(group);
+
+                if(isProfiled) measureImbalance(parity);
+            }
+
+            float maxFlow = 0;
+            lakeFlow.assign(lakes.size(), 0);
+
+            for(stripe& currentStripe : stripes){
+                for(std::pair<int, float>& inflow : currentStripe.lakeInflow){
+                    addToLake(inflow.first, inflow.second);
+
+                    lakeFlow[inflow.first - 1] += inflow.second;
+                }
+
+                maxFlow = std::max(maxFlow, currentStripe.maxFlow);
+
+                currentStripe.lakeInflow.clear(scheduler->threadIndex());
+
+                removedMass += currentStripe.removedMass;
+                currentStripe.removedMass = 0;
+            }
+
+            //After inflow of all stripes is added, so it's spread over the cells of the woken lakes
+            for(stripe& currentStripe : stripes){
+                for(int lakeID : currentStripe.lakesToWake){
+                    if(lakes[lakeID - 1].isAlive()) wakeLake(lakeID);
+                }
+
+                currentStripe.lakesToWake.clear();
+            }
+
+            updateLakes();
+
+            stepsSinceRebalance++;
+
+            if(balanceStripes && stepsSinceRebalance >= rebalanceInterval){
+                rebalanceStripes();
+                stepsSinceRebalance = 0;
+            }
+
+            //---Steady state---
+            for(float flow : lakeFlow){
+                maxFlow = std::max(maxFlow, (float)fabs(flow));
+            }
+
+            stepsDone++;
+
+            if(maxFlow < steadyFlow) quietStepsInRow++;
+            else quietStepsInRow = 0;
+
+            if(quietStepsInRow >= steadySteps && settledStep < 0) settledStep = stepsDone;
+            else if(quietStepsInRow == 0) settledStep = -1;
+            //------
+
+            if(isProfiled){
+                profiledStepTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count();
+                profiledSteps++;
+            }
+        }
+
+        //Pins threads of the scheduler according to pinThreads and prints the topology in use
+        //Threads are spread in order of nodes, same as rows in firstHomeRow()
+        void placeThreads(){
+            std::vector<std::vector<int>> nodes = readNumaNodes();
+            std::vector<int> allCpus;
+
+            std::cout << "NUMA nodes: " << nodes.size() << std::endl;
+
+            for(int node = 0; node < (int)nodes.size(); node++){
+                std::cout << "  node " << node << ": CPUs " << formatCpuList(nodes[node]) << std::endl;
+
+                allCpus.insert(allCpus.end(), nodes[node].begin(), nodes[node].end());
+            }
+
+            int threads = scheduler->threadsAmount();
+
+            std::cout << "Simulation threads: " << threads << ", pinning: " << pinThreads << std::endl;
+
+            std::vector<std::vector<int>> threadCpus(threads);
+
+            for(int thread = 0; thread < threads; thread++){
+                if(pinThreads == "cores"){
+                    threadCpus[thread] = {allCpus[thread % allCpus.size()]};
+                }
+                else if(pinThreads == "nodes"){
+                    threadCpus[thread] = nodes[thread * nodes.size() / threads];
+                }
+            }
+
+            std::vector<char> pinned(threads, false);
+            TaskScheduler::taskGroup group;
+
+            for(int thread = 0; thread < threads; thread++){
+                if(threadCpus[thread].empty()) continue;
+
+                scheduler->submitPinned(group, [&, thread]{ pinned[thread] = pinCurrentThread(threadCpus[thread]); }, thread);
+            }
+
+            scheduler->wait(group);
+
+            for(int thread = 0; thread < threads; thread++){
+                std::cout << "  thread " << thread << ": rows " << firstHomeRow(thread) << "-" << firstHomeRow(thread + 1) - 1;
+
+                if(!threadCpus[thread].empty()){
+                    std::cout << ", CPUs " << formatCpuList(threadCpus[thread]) << (pinned[thread] ? "" : " (pinning failed)");
+                }
+
+                std::cout << std::endl;
+            }
+        }
+
+        //Summary of a single cell for summaries
+        //Water that flowed in or out of a lake isn't in its cells yet, so it's counted in its surface
+        SummaryPyramid::summary cellSummary(int x, int y){
+            const cell& currentCell = matrix[y][x];
+
+            if(currentCell.value == solidBlockID) return {0, 0, 1};
+
+            float mass = std::max(currentCell.value, 0.f);
+
+            if(currentCell.lake && (y == 0 || matrix[y - 1][x].lake != currentCell.lake)){
+                mass += lakes[currentCell.lake - 1].level;
+            }
+
+            return {mass, mass, 0};
+        }
+
+        //Brings summaries up to date, only chunks that could have changed since the last update are calculated again:
+        //chunks with water simulated cell by cell now or at the last update, edited chunks
+        //and chunks with surfaces of lakes whose level changed
+        void updateSummaries(){
+            int chunkLevel = summaries.getChunkLevel();
+
+            for(int chunk : liquidChunks){
+                summaries.markChunk(chunk);
+                isLiquidChunk[chunk] = false;
+            }
+
+            liquidChunks.clear();
+
+            for(int y = 0; y < matrixSize.y; y++){
+                for(int word = 0; word < maskWords; word++){
+                    uint64_t bits = liquidMask[y][word] & ~lakeMask[y][word];
+
+                    while(bits){
+                        int x = word * 64 + __builtin_ctzll(bits);
+                        int chunk = summaries.chunkIndex(x, y);
+
+                        if(!isLiquidChunk[chunk]){
+                            isLiquidChunk[chunk] = true;
+                            liquidChunks.push_back(chunk);
+                            summaries.markChunk(chunk);
+                        }
+
+                        //Rest of the chunk in this word is already marked
+                        int nextChunk = ((x >> chunkLevel) + 1) << chunkLevel;
+
+                        if(nextChunk - word * 64 >= 64) break;
+
+                        bits &= ~uint64_t(0) << (nextChunk - word * 64);
+                    }
+                }
+            }
+
+            for(lake& currentLake : lakes){
+                if(!currentLake.isAlive() || currentLake.level == currentLake.summarizedLevel) continue;
+
+                for(olc::vi2d& position : currentLake.surface){
+                    summaries.markCell(position.x, position.y);
+                }
+
+                currentLake.summarizedLevel = currentLake.level;
+            }
+
+            //Chunks are independent, so they are calculated in parallel
+            const std::vector<int>& changed = summaries.changedChunks();
+            auto readCell = [this](int x, int y){ return cellSummary(x, y); };
+
+            TaskScheduler::taskGroup group;
+            int batch = std::max((int)changed.size() / (scheduler->threadsAmount() * 4), 1);
+
+            for(int first = 0; first < (int)changed.size(); first += batch){
+                scheduler->submit(group, [this, &changed, &readCell, first, batch]{
+                    for(int i = first; i < std::min(first + batch, (int)changed.size()); i++){
+                        summaries.updateChunk(changed[i], readCell);
+                    }
+                });
+            }
+
+            scheduler->wait(group);
+
+            summaries.updateAncestors(readCell);
+        }
+
+    public:
+        //Reads optional simulation settings, missing ones keep their default values
+        void loadSettings(const nlohmann::json& config){
+            massEpsilon = config.value("massEpsilon", massEpsilon);
+            threadsAmount = config.value("threads", threadsAmount);
+            stripeHeight = std::max(config.value("stripeHeight", stripeHeight), 2);
+            balanceStripes = config.value("balanceStripes", balanceStripes);
+            pinThreads = config.value("pinThreads", pinThreads);
+            hugePages = config.value("hugePages", hugePages);
+            dropPagesSize = config.value("dropPagesSize", dropPagesSize);
+            steadyFlow = config.value("steadyFlow", steadyFlow);
+            steadySteps = std::max(config.value("steadySteps", steadySteps), 1);
+        }
+
+        //Starts threads and creates an empty matrix of given size
+        //printSetup turns off printing of the topology and memory in use
+        void create(olc::vi2d size, bool printSetup = true){
+            matrixSize = size;
+
+            //Simulation runs on this thread and on threads of the scheduler
+            enableFlushToZero();
+
+            if(threadsAmount <= 0) threadsAmount = std::max(1u, std::thread::hardware_concurrency());
+
+            scheduler = std::make_unique<TaskScheduler>(threadsAmount, enableFlushToZero);
+            blockPool = std::make_unique<BlockPool>(poolBlockSize, threadsAmount);
+
+            //Threads are pinned before they touch memory of the matrix
+            if(printSetup || pinThreads != "none") placeThreads();
+
+            //---Initialization of cellular automaton matrix---
+            initializeMatrix();
+
+            if(printSetup){
+                std::cout << "Matrix: " << matrix.getBuffer().bytes() / 1024 << " KiB, " << matrix.getBuffer().pagesDescription() << std::endl;
+            }
+            //------
+        }
+
+        //Empties the matrix, its memory is reused
+        void reset(){
+            initializeMatrix();
+        }
+
+        void setParameters(float newCompression, float newFlowDivider){
+            compression = newCompression;
+            flowDivider = newFlowDivider;
+        }
+
+        //Turns on timing of steps and stripes shown by the profiler
+        void setProfiled(bool profiled){
+            isProfiled = profiled;
+        }
+
+        //Fills the matrix with text rows: '#' is a solid block, '~' a cell full of water,
+        //anything else is left empty. Parts outside of the matrix are ignored
+        void loadMap(const std::vector<std::string>& rows){
+            for(int y = 0; y < std::min((int)rows.size(), matrixSize.y); y++){
+                for(int x = 0; x < std::min((int)rows[y].size(), matrixSize.x); x++){
+                    if(rows[y][x] == '#') matrix[y][x].value = solidBlockID;
+                    else if(rows[y][x] == '~') matrix[y][x].value = maxWaterValue;
+                    else continue;
+
+                    updateMasks(x, y);
+                    summaries.markCell(x, y);
+                }
+            }
+        }
+
+        //One iteration over all cells
+        void step(){
+            simulationStep();
+        }
+
+        olc::vi2d getSize() const{
+            return matrixSize;
+        }
+
+        //Value of the cell as it's drawn: water or solidBlockID
+        float getCellValue(int x, int y) const{
+            return matrix[y][x].value;
+        }
+
+        //Whether water fell through the cell since the last clearFalling()
+        bool isFalling(int x, int y) const{
+            return (fallingMask[y][x >> 6] >> (x & 63)) & 1;
+        }
+
+        //Has to be called after every drawn frame, so streams that stopped aren't drawn any more
+        void clearFalling(){
+            for(std::vector<uint64_t>& row : fallingMask){
+                std::fill(row.begin(), row.end(), 0);
+            }
+        }
+
+        float getMaxWaterValue() const{
+            return maxWaterValue;
+        }
+
+        //Threads of the simulation, free to use between steps
+        TaskScheduler& getScheduler(){
+            return *scheduler;
+        }
+
+        //Has to be called when parameters or cells were changed from outside of the simulation,
+        //so steady state is searched for again
+        void disturb(){
+            quietStepsInRow = 0;
+            settledStep = -1;
+        }
+
+        //True when nothing moved for steadySteps steps
+        bool isSettled() const{
+            return settledStep >= 0;
+        }
+
+        //Step after which the matrix was found settled, -1 if it's still moving
+        long getSettledStep() const{
+            return settledStep;
+        }
+
+        long getStepsDone() const{
+            return stepsDone;
+        }
+
+        //Water in every row, lakes included
+        std::vector<double> getRowMass(){
+            std::vector<double> rowMass(matrixSize.y, 0);
+
+            for(int y = 0; y < matrixSize.y; y++){
+                for(int x = 0; x < matrixSize.x; x++){
+                    const cell& currentCell = matrix[y][x];
+
+                    if(currentCell.value != solidBlockID) rowMass[y] += currentCell.value;
+                }
+            }
+
+            for(const lake& currentLake : lakes){
+                for(const olc::vi2d& position : currentLake.surface){
+                    rowMass[position.y] += currentLake.level;
+                }
+            }
+
+            return rowMass;
+        }
+
+        statistics getStatistics(){
+            statistics result = {0, 0, removedMass, 0, 0, 0};
+
+            for(int y = 0; y < matrixSize.y; y++){
+                for(int x = 0; x < matrixSize.x; x++){
+                    const cell& currentCell = matrix[y][x];
+
+                    if(currentCell.value == solidBlockID || currentCell.value == 0) continue;
+
+                    result.water += currentCell.value;
+
+                    //Remains below zero count towards water, but the cell is empty
+                    if(currentCell.value < 0) continue;
+
+                    if(currentCell.lake){
+                        result.lakeWater += currentCell.value;
+                        result.lakeCells++;
+                    }
+                    else{
+                        result.liquidCells++;
+                    }
+                }
+            }
+
+            //Water that flowed in or out of lakes isn't in their cells yet
+            for(const lake& currentLake : lakes){
+                if(!currentLake.isAlive()) continue;
+
+                result.water += (double)currentLake.level * currentLake.surface.size();
+                result.lakeWater += (double)currentLake.level * currentLake.surface.size();
+                result.lakes++;
+            }
+
+            return result;
+        }
+};
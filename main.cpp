@@ -11,11 +11,16 @@
 #include <fstream>
 #include "nlohmann/json.hpp"
 
-#include <algorithm>
+#include <map>
+#include <optional>
 
-#define solidBlockID 999
+#include "liquidSimulation.h"
+#include "ensembleRunner.h"
+#include "softwareRenderer.h"
+#include "frameExporter.h"
+#include "thickLine.h"
 
-class LiquidSimulator : public olc::PixelGameEngine{
+class LiquidSimulator : public olc::PixelGameEngine, public LiquidSimulation{
     private:
         //---User input section---
         float panelWidthPercent = 35;
@@ -25,45 +30,92 @@ class LiquidSimulator : public olc::PixelGameEngine{
         //---Need to be initialized in OnUserCreate()---
         olc::vi2d panelSize;
         olc::vi2d simulationSize;
-        olc::vi2d matrixSize;
 
         float interfaceFactor;
         //------
-        
-        struct cell{
-            float value;
-            bool isFalling;
-
-            cell(float value, bool isFalling) : value(value), isFalling(isFalling){}
-        };
-
-        //Main matrix used for calculation
-        std::vector<std::vector<cell>> matrix;
 
         //---Graphic---
+        //Kept on the CPU side too, so tiles can be copied into the solid layer
+        std::unique_ptr<olc::Sprite> spriteSheet;
         std::unique_ptr<olc::Decal> decalSheet;
 
         olc::vi2d tileSize = {4, 4};
         //------
 
-        float minFlow = 0.5;
-        char maxWaterValue = 4;
-        
+        //---Camera---
+        //Matrix can be bigger than the simulation area (worldWidth and worldHeight in config.json),
+        //the camera shows a part of it. 0 means that the matrix fills the simulation area
+        olc::vi2d worldSize = {0, 0};
+        //Cell in the top left corner of the simulation area
+        olc::vf2d cameraPosition = {0, 0};
+        //Cell takes tileSize * zoom pixels on the screen
+        float zoom = 1;
+        float minZoom = 1.f / 16;
+        float maxZoom = 8;
+        //Screen pixels per second
+        float panSpeed = 400;
+        //------
+
+        //---Level of detail---
+        //When a cell is smaller than that many pixels, the visible part of the matrix is drawn
+        //as one image with a pixel for every screen pixel instead of a decal for every cell
+        float lodCellSize = 2;
+        std::unique_ptr<olc::Sprite> lodSprite;
+        std::unique_ptr<olc::Decal> lodDecal;
+        //Average colours of tiles, used for pixels of the image
+        olc::Pixel waterColor;
+        olc::Pixel solidColor;
+        //------
+
+        //---Solid layer---
+        //Solid blocks change only when the user edits them, so they are drawn once into chunks
+        //of solidChunkSize x solidChunkSize cells, and a chunk is uploaded again only after its blocks changed
+        //Only visible chunks with solid blocks have an image, it's given back when the chunk goes off screen
+        struct solidChunk{
+            std::unique_ptr<olc::Sprite> sprite;
+            std::unique_ptr<olc::Decal> decal;
+            bool isDirty;
+            bool hasSolids;
+        };
+
+        int solidChunkSize = 64;
+        olc::vi2d solidChunksAmount;
+        std::vector<solidChunk> solidChunks;
+        //Chunks that have an image
+        std::vector<int> loadedChunks;
+        //Images given back by chunks, all of them have the size of a whole chunk
+        std::vector<std::pair<std::unique_ptr<olc::Sprite>, std::unique_ptr<olc::Decal>>> spareChunkImages;
+        //------
+
         //---Parameters---
-        float compression = 0.4;
-        float flowDivider = 1;
         //We have to stop dividing at some point
         float stepsPerFrame = 5;
+
+        //Picks stepsPerFrame every frame so the frame fits in frameBudget (milliseconds)
+        float autoSteps = 0;
+        float frameBudget = 16.6;
+
         float brushSize = 2;
 
+        //Index of ThickLine::shapes
+        float brushShape = 0;
+
         //Float instead of bool so it can be compatible
         //with parametersToChange array
         //0 -> false
         //1 -> true
         float drawLines = 0;
+
+        //Index of the overlay, names are in choices of its parameter
+        float debugOverlay = 0;
+
+        //Float instead of bool, like drawLines, see Input latency
+        float lowLatency = 0;
         //------
 
-        enum parametersTypes {par_float, par_int, par_bool};
+        enum parametersTypes {par_float, par_int, par_bool, par_choice};
+
+        enum brushTools {tool_solid, tool_water, tool_erase};
 
         struct varParameter{
             float& value;
@@ -73,11 +125,17 @@ class LiquidSimulator : public olc::PixelGameEngine{
             float step;
             float minValue;
             float maxValue;
+            //Names of values of par_choice parameters
+            std::vector<std::string> choices;
 
             varParameter(float& value, parametersTypes type, std::string label, float step, float minValue = -INFINITY, float maxValue = INFINITY)
             : value(value), type(type), label(label), step(step), minValue(minValue), maxValue(maxValue), defaultValue(value){
             }
 
+            varParameter(float& value, std::vector<std::string> choices, std::string label)
+            : value(value), defaultValue(value), type(par_choice), label(label), step(1), minValue(0), maxValue(choices.size() - 1), choices(choices){
+            }
+
             void increase(){
                 value += step;
 
@@ -100,73 +158,124 @@ class LiquidSimulator : public olc::PixelGameEngine{
         };
 
         //---Panel variables---
-        varParameter parametersToChange[5] = {
+        varParameter parametersToChange[13] = {
             varParameter(compression, par_float, "Compression: ", 0.001),
             varParameter(flowDivider, par_float, "Flow divider: ", 0.001, 1),
             varParameter(stepsPerFrame, par_int, "Steps per frame: ", 1, 1),
+            varParameter(autoSteps, par_bool, "Auto steps: ", 1, 0, 1),
+            varParameter(frameBudget, par_float, "Frame budget (ms): ", 0.1, 1),
+            varParameter(equalizePools, par_bool, "Equalize pools: ", 1, 0, 1),
+            varParameter(mergeLakes, par_bool, "Settled lakes: ", 1, 0, 1),
+            varParameter(terminalVelocity, par_int, "Terminal velocity: ", 1, 1),
             varParameter(brushSize, par_int, "Brush size: ", 1),
-            varParameter(drawLines, par_bool, "Draw lines: ", 1, 0, 1)
+            varParameter(brushShape, {"Square", "Round"}, "Brush shape: "),
+            varParameter(drawLines, par_bool, "Draw lines: ", 1, 0, 1),
+            varParameter(debugOverlay, {"Off", "Flow", "Falling", "Activity", "Stripe cost", "Threads"}, "Overlay: "),
+            varParameter(lowLatency, par_bool, "Low latency: ", 1, 0, 1)
         };
 
-        char parametersAmount = 5;
-        char graphicParameters = 2;
+        char parametersAmount = 13;
+        char graphicParameters = 5;
         char activeOption = 0;
         //------
 
-        //matrixSizes have to be initialized before calling this method
-        void initializeMatrix(){
-            matrix.clear();
-
-            for(int y = 0; y < matrixSize.y; y++){
-                std::vector<cell> row;
-
-                for(int x = 0; x < matrixSize.x; x++){
-                    //Filling everything with 0
-                    row.push_back(cell(0, false));
-                }
+        //---Auto steps---
+        //Averaged time of one simulation step and of everything else in a frame (milliseconds)
+        float stepTime = 0;
+        float frameOverhead = 0;
+        //Steps per frame are changed only when they are off by more than that fraction
+        float stepsHysteresis = 0.15;
+        int maxAutoSteps = 1000;
+
+        //Measured in the previous frame
+        float lastSimulationTime = 0;
+        int lastSteps = 0;
+        //------
 
-                matrix.push_back(row);
-            }
-        }
+        //---Profiler---
+        //Toggled with F1, drawn over the top left corner of the simulation area
+        bool showProfiler = false;
+        //Seconds between refreshes of shown values
+        float profilerInterval = 0.5;
+        float profilerTimer = 0;
+        std::vector<std::string> profilerLines;
+        //Lines are drawn into an image only when they are refreshed
+        std::unique_ptr<olc::Sprite> profilerSprite;
+        std::unique_ptr<olc::Decal> profilerDecal;
+        //------
 
-        //Returns neighour of currentPosition, defined by versor
-        //Returns -1 if out of range
-        float getNeighbour(olc::vi2d currentPosition, olc::vi2d versor){
-            int positionX = currentPosition.x + versor.x;
-            int positionY = currentPosition.y + versor.y;
+        //---Panel image---
+        //Panel is drawn into an image only when a value or the selected option changes
+        std::unique_ptr<olc::Sprite> panelSprite;
+        std::unique_ptr<olc::Decal> panelDecal;
+        //Shown on the image
+        std::vector<float> shownValues;
+        int shownOption = -1;
+        //------
 
-            if(positionX < matrixSize.x && positionY < matrixSize.y && positionX >= 0 && positionY >= 0){
-                return matrix[positionY][positionX].value;
-            }
-            else{
-                return -1;
-            }
-        }
+        //---Idle mode---
+        //When the simulation settled and the user does nothing, steps are skipped
+        //and frames are slowed down to idleFrameRate
+        float idleFrameRate = 10;
+        bool isIdle = false;
+        olc::vi2d lastMousePosition;
+        //Settled step that was already printed
+        long reportedSettledStep = -1;
+        //------
 
-        //Returns amount of water that should flow from source to sink
-        float waterFlowDown(float source, float sink){
-            float sum = source + sink;
+        //---Input latency---
+        //Time from polling input that changed cells to showing the frame with the change,
+        //measured at the start of the next frame, after the previous one was presented
+        //Steps of the frame are done between the two, so many steps per frame make the brush lag behind the cursor.
+        //In low latency mode frames in which cells are edited do only steps that fit into latencyBudget (milliseconds),
+        //steps left out are done in the following frames, and the brush is drawn at the cursor
+        float latencyBudget = 8;
+        int deferredSteps = 0;
+        std::chrono::steady_clock::time_point inputTime;
+        bool isLatencyMeasured = false;
+        //Gathered since the last refresh of the profiler
+        float profiledLatency = 0;
+        float profiledLatencyMax = 0;
+        int profiledLatencies = 0;
+        //------
 
-            //If all water from source will fit in the sink
-            if(sum <= maxWaterValue){
-                return source;
-            }
-            //If not all water from source will fit in the sink and source wouldn't be full
-            //It means that bottom cell will become compressed but only proportionally to the amount of water above
-            else if(sum < (2 * maxWaterValue + compression)){
-                return (maxWaterValue * maxWaterValue + sum * compression) / (maxWaterValue + compression) - sink;
-            }
-            else{
-                return ((sum + compression) / 2) - sink;
-            }
-        }
+        //---Frame pacing---
+        //Frames are shown at most maxFrameRate times per second (0 - no limit), even without vsync,
+        //and at most unfocusedFrameRate times when the window isn't focused (like when it's minimized)
+        //Slowed down frames do proportionally more steps, so the simulation keeps its pace
+        float maxFrameRate = 60;
+        float unfocusedFrameRate = 2;
+        //Limit of the current frame, 0 - no limit
+        float targetFrameRate = 0;
+        //Frames wait at their start, after the previous one was presented, so the wait doesn't delay showing it
+        std::chrono::steady_clock::time_point lastFrameStart;
+        //Time slept at the start of the last frame (milliseconds), it isn't a cost of the frame
+        float lastSleepTime = 0;
+        //------
 
-        float waterFlowUp(float source, float sink){
-            return source - (waterFlowDown(source, sink) + sink);
-        }
+        //---Debug overlay---
+        //Drawn over the simulation area to show why a scene is slow, chosen with debugOverlay:
+        //Flow - all water that went in and out of every cell in the last step (gross, not net), from blue (little) through red to yellow (a lot), logarithmic
+        //Falling - cells marked as falling
+        //Activity - simulated cells in red, settled ones waiting to join a lake in green, lakes in blue,
+        //stripes skipped in the last step in grey and borders of stripes as lines
+        //Stripe cost - time of every stripe in the last step compared to the slowest one
+        //Threads - colour of the thread that updated the stripe in the last step
+        enum overlays {overlay_off, overlay_flow, overlay_falling, overlay_activity, overlay_stripeCost, overlay_threads};
+
+        std::unique_ptr<olc::Sprite> overlaySprite;
+        std::unique_ptr<olc::Decal> overlayDecal;
+        //Index of the stripe of every row and time of the slowest stripe, refreshed before drawing
+        std::vector<int> rowStripes;
+        float maxStripeTime = 0;
+
+        const olc::Pixel threadColors[8] = {
+            olc::RED, olc::GREEN, olc::BLUE, olc::YELLOW, olc::CYAN, olc::MAGENTA, olc::Pixel(255, 128, 0), olc::WHITE
+        };
+        //------
 
         //Transform given parameter number value to string to be rendered
-        std::string formatNumber(varParameter parameter){
+        std::string formatNumber(const varParameter& parameter){
             std::stringstream stream;
 
             if(parameter.type == par_float){
@@ -180,6 +289,9 @@ class LiquidSimulator : public olc::PixelGameEngine{
 
                 stream << label[(int)parameter.value];
             }
+            else if(parameter.type == par_choice){
+                stream << parameter.choices[(int)parameter.value];
+            }
 
             return stream.str();
         }
@@ -216,83 +328,791 @@ class LiquidSimulator : public olc::PixelGameEngine{
 
         interfacePositions panelPositions;
 
-        void drawMatrixLine(olc::vi2d startPosition, olc::vi2d endPosition){
-            int dx =  abs(endPosition.x - startPosition.x);
-            int sx = startPosition.x < endPosition.x ? 1 : -1;
+        //Creates chunks of the solid layer without images, they get them in drawSolidLayer()
+        void createSolidLayer(){
+            solidChunksAmount = (matrixSize + olc::vi2d(solidChunkSize - 1, solidChunkSize - 1)) / solidChunkSize;
+            solidChunks.clear();
+            solidChunks.resize(solidChunksAmount.x * solidChunksAmount.y);
+            loadedChunks.clear();
+
+            for(solidChunk& chunk : solidChunks){
+                chunk.isDirty = true;
+                chunk.hasSolids = false;
+            }
+        }
+
+        //Has to be called when the cell became solid or stopped being solid
+        void markSolidChanged(int x, int y){
+            solidChunks[(y / solidChunkSize) * solidChunksAmount.x + x / solidChunkSize].isDirty = true;
+        }
+
+        //Gives the chunk an image, a spare one if there is any
+        void loadSolidChunk(int index){
+            solidChunk& chunk = solidChunks[index];
+
+            if(chunk.sprite) return;
+
+            if(spareChunkImages.empty()){
+                chunk.sprite = std::make_unique<olc::Sprite>(solidChunkSize * tileSize.x, solidChunkSize * tileSize.y);
+                chunk.decal = std::make_unique<olc::Decal>(chunk.sprite.get());
+            }
+            else{
+                chunk.sprite = std::move(spareChunkImages.back().first);
+                chunk.decal = std::move(spareChunkImages.back().second);
+                spareChunkImages.pop_back();
+            }
+
+            loadedChunks.push_back(index);
+        }
+
+        //Takes images back from chunks outside of the given range (last one excluded) and from chunks without solid blocks
+        //Such chunk is drawn again when it becomes visible
+        void releaseSolidChunks(olc::vi2d firstChunk, olc::vi2d lastChunk){
+            for(int i = 0; i < (int)loadedChunks.size(); i++){
+                int index = loadedChunks[i];
+                solidChunk& chunk = solidChunks[index];
+                olc::vi2d chunkPosition = {index % solidChunksAmount.x, index / solidChunksAmount.x};
+
+                bool isVisible = chunkPosition.x >= firstChunk.x && chunkPosition.x < lastChunk.x
+                    && chunkPosition.y >= firstChunk.y && chunkPosition.y < lastChunk.y;
+
+                if(isVisible && chunk.hasSolids) continue;
+
+                spareChunkImages.push_back({std::move(chunk.sprite), std::move(chunk.decal)});
+                chunk.isDirty = true;
+
+                loadedChunks[i] = loadedChunks.back();
+                loadedChunks.pop_back();
+                i--;
+            }
+        }
+
+        //Draws solid blocks of the chunk again and uploads them
+        //Chunk without solid blocks doesn't get an image
+        void updateSolidChunk(int index){
+            solidChunk& chunk = solidChunks[index];
+            olc::vi2d origin = olc::vi2d(index % solidChunksAmount.x, index / solidChunksAmount.x) * solidChunkSize;
+            olc::vi2d cells = {std::min(solidChunkSize, matrixSize.x - origin.x), std::min(solidChunkSize, matrixSize.y - origin.y)};
+
+            chunk.isDirty = false;
+            chunk.hasSolids = false;
+
+            for(int y = 0; y < cells.y && !chunk.hasSolids; y++){
+                for(int x = 0; x < cells.x; x++){
+                    if(matrix[origin.y + y][origin.x + x].value == solidBlockID){
+                        chunk.hasSolids = true;
+                        break;
+                    }
+                }
+            }
+
+            if(!chunk.hasSolids) return;
 
-            int dy = -abs(endPosition.y - startPosition.y);
-            int sy = startPosition.y < endPosition.y ? 1 : -1;
+            loadSolidChunk(index);
 
-            int err = dx + dy;
-            int e2;
-            
+            olc::vi2d solidTile = olc::vi2d(4, 0) * tileSize;
 
-            while(1){
-                //Very unefficient way of drawing line with specific thickness
-                //But it's easy and it works
-                int left = startPosition.x - (brushSize / 2);
-                int up = startPosition.y - (brushSize / 2);
+            //Images are reused between chunks, so all of it is drawn, also cells outside of the matrix in chunks at its edges
+            for(int y = 0; y < solidChunkSize; y++){
+                for(int x = 0; x < solidChunkSize; x++){
+                    bool isSolid = x < cells.x && y < cells.y && matrix[origin.y + y][origin.x + x].value == solidBlockID;
 
-                for(int i = left; i <= left + brushSize; i++){
-                    for(int j = up; j <= up + brushSize; j++){
-                        if(getNeighbour({i, j}, {0, 0}) != -1){
-                            matrix[j][i].value = solidBlockID;
+                    for(int pixelY = 0; pixelY < tileSize.y; pixelY++){
+                        for(int pixelX = 0; pixelX < tileSize.x; pixelX++){
+                            olc::Pixel pixel = isSolid ? spriteSheet->GetPixel(solidTile.x + pixelX, solidTile.y + pixelY) : olc::BLANK;
+
+                            chunk.sprite->SetPixel(x * tileSize.x + pixelX, y * tileSize.y + pixelY, pixel);
                         }
                     }
                 }
-                //------
+            }
+
+            chunk.decal->Update();
+        }
 
-                if(startPosition.x == endPosition.x && startPosition.y == endPosition.y) break;
+        //Only chunks that are at least partly visible are updated and drawn, others give their images back
+        void drawSolidLayer(){
+            olc::vi2d first, last;
+            visibleCells(first, last);
 
-                e2 = 2 * err;
+            olc::vi2d firstChunk = first / solidChunkSize;
+            olc::vi2d lastChunk = (last + olc::vi2d(solidChunkSize - 1, solidChunkSize - 1)) / solidChunkSize;
 
-                if(e2 >= dy){
-                    err += dy;
-                    startPosition.x += sx;
+            if(first.x >= last.x || first.y >= last.y) lastChunk = firstChunk;
+
+            for(int chunkY = firstChunk.y; chunkY < lastChunk.y; chunkY++){
+                for(int chunkX = firstChunk.x; chunkX < lastChunk.x; chunkX++){
+                    int index = chunkY * solidChunksAmount.x + chunkX;
+                    solidChunk& chunk = solidChunks[index];
+
+                    if(chunk.isDirty) updateSolidChunk(index);
+
+                    if(chunk.hasSolids) DrawDecal(cellToScreen(olc::vi2d(chunkX, chunkY) * solidChunkSize), chunk.decal.get(), {zoom, zoom});
                 }
+            }
+
+            releaseSolidChunks(firstChunk, lastChunk);
+        }
+
+        //---Camera---
+        float cellScreenSize(){
+            return tileSize.x * zoom;
+        }
+
+        olc::vi2d screenToCell(olc::vi2d screenPosition){
+            olc::vf2d position = cameraPosition + olc::vf2d(screenPosition) / cellScreenSize();
+
+            return {(int)floor(position.x), (int)floor(position.y)};
+        }
+
+        olc::vf2d cellToScreen(olc::vf2d cellPosition){
+            return (cellPosition - cameraPosition) * cellScreenSize();
+        }
+
+        //Range of cells in the simulation area, last one is excluded
+        void visibleCells(olc::vi2d& first, olc::vi2d& last){
+            olc::vf2d end = cameraPosition + olc::vf2d(simulationSize) / cellScreenSize();
+
+            first = {std::max((int)floor(cameraPosition.x), 0), std::max((int)floor(cameraPosition.y), 0)};
+            last = {std::min((int)ceil(end.x), matrixSize.x), std::min((int)ceil(end.y), matrixSize.y)};
+
+            last = {std::max(last.x, first.x), std::max(last.y, first.y)};
+        }
+
+        //W, A, S, D move the camera, mouse wheel zooms in and out around the cursor, Home resets the view
+        void updateCamera(float fElapsedTime){
+            olc::vf2d direction = {0, 0};
+
+            if(GetKey(olc::Key::A).bHeld) direction.x -= 1;
+            if(GetKey(olc::Key::D).bHeld) direction.x += 1;
+            if(GetKey(olc::Key::W).bHeld) direction.y -= 1;
+            if(GetKey(olc::Key::S).bHeld) direction.y += 1;
+
+            cameraPosition += direction * panSpeed * fElapsedTime / cellScreenSize();
+
+            if(GetMouseWheel() != 0){
+                olc::vf2d mouse = GetMousePos();
+                olc::vf2d cellUnderMouse = cameraPosition + mouse / cellScreenSize();
+
+                zoom *= GetMouseWheel() > 0 ? 1.25f : 0.8f;
+                zoom = std::min(std::max(zoom, minZoom), maxZoom);
+
+                //Cell under the cursor stays in place
+                cameraPosition = cellUnderMouse - mouse / cellScreenSize();
+            }
 
-                if(e2 <= dx){
-                    err += dx;
-                    startPosition.y += sy;
+            if(GetKey(olc::Key::HOME).bPressed){
+                cameraPosition = {0, 0};
+                zoom = 1;
+            }
+
+            //At least half of the simulation area shows the matrix
+            olc::vf2d halfView = olc::vf2d(simulationSize) / cellScreenSize() / 2;
+
+            cameraPosition.x = std::min(std::max(cameraPosition.x, -halfView.x), matrixSize.x - halfView.x);
+            cameraPosition.y = std::min(std::max(cameraPosition.y, -halfView.y), matrixSize.y - halfView.y);
+        }
+        //------
+
+        olc::Pixel averageColor(olc::vi2d tile){
+            int sum[3] = {0, 0, 0};
+
+            for(int y = 0; y < tileSize.y; y++){
+                for(int x = 0; x < tileSize.x; x++){
+                    olc::Pixel pixel = spriteSheet->GetPixel(tile.x * tileSize.x + x, tile.y * tileSize.y + y);
+
+                    sum[0] += pixel.r;
+                    sum[1] += pixel.g;
+                    sum[2] += pixel.b;
                 }
             }
+
+            int pixels = tileSize.x * tileSize.y;
+
+            return olc::Pixel(sum[0] / pixels, sum[1] / pixels, sum[2] / pixels);
         }
 
-        void drawPanel(){
+        //Tint of water darkened by compression, between 255 (no change) and 64 (dark)
+        int compressionTint(float value){
+            return SoftwareRenderer::compressionTint(value, maxWaterValue);
+        }
+
+        //Draws visible part of the matrix as one image, every screen pixel takes the colour of the cell under it
+        //Cost depends only on the size of the simulation area
+        void drawLevelOfDetail(){
+            float cellSize = cellScreenSize();
+
+            //Many cells under one pixel are drawn from summaries of blocks that are about as big as the pixel
+            int level = 0;
+
+            if(cellSize < 1){
+                updateSummaries();
+                level = std::min((int)floor(log2(1 / cellSize)), summaries.levelsAmount() - 1);
+            }
+
+            std::vector<int> columns(simulationSize.x);
+
+            for(int screenX = 0; screenX < simulationSize.x; screenX++){
+                columns[screenX] = (int)floor(cameraPosition.x + screenX / cellSize);
+            }
+
+            for(int screenY = 0; screenY < simulationSize.y; screenY++){
+                int y = (int)floor(cameraPosition.y + screenY / cellSize);
+
+                for(int screenX = 0; screenX < simulationSize.x; screenX++){
+                    int x = columns[screenX];
+                    olc::Pixel pixel = olc::BLACK;
+
+                    if(x >= 0 && x < matrixSize.x && y >= 0 && y < matrixSize.y){
+                        if(level > 0){
+                            int blockX = x >> level;
+                            int blockY = y >> level;
+                            const SummaryPyramid::summary& block = summaries.getBlock(level, blockX, blockY);
+                            int cells = summaries.blockCells(level, blockX, blockY);
+                            int liquidCells = cells - block.solidCells;
+
+                            float fill = liquidCells > 0 ? std::min((float)(block.mass / (liquidCells * maxWaterValue)), 1.f) : 0;
+                            olc::Pixel water = waterColor * (fill * compressionTint(block.maxPressure) / 255.f);
+
+                            pixel = olc::PixelLerp(water, solidColor, (float)block.solidCells / cells);
+                        }
+                        else{
+                            float value = matrix[y][x].value;
+
+                            if(value == solidBlockID){
+                                pixel = solidColor;
+                            }
+                            else if(value > 0){
+                                //Partly filled cells are darker, like their smaller tiles
+                                float fill = std::min(value / maxWaterValue, 1.f);
+
+                                pixel = waterColor * (fill * compressionTint(value) / 255.f);
+                            }
+                        }
+                    }
+
+                    lodSprite->SetPixel(screenX, screenY, pixel);
+                }
+            }
+
+            lodDecal->Update();
+            DrawDecal({0, 0}, lodDecal.get());
+        }
+
+        //Draws visible cells, solid blocks come from the cached layer and water is drawn cell by cell
+        //Falling marks of the whole matrix are cleared afterwards, also of cells that weren't drawn
+        void drawMatrix(){
+            if(cellScreenSize() < lodCellSize){
+                drawLevelOfDetail();
+                clearFalling();
+
+                //Solid layer isn't drawn, so none of its chunks needs an image
+                releaseSolidChunks({0, 0}, {0, 0});
+
+                return;
+            }
+
+            drawSolidLayer();
+
+            olc::vi2d first, last;
+            visibleCells(first, last);
+
+            olc::vf2d scale = {zoom, zoom};
+
+            for(int y = first.y; y < last.y; y++){
+                for(int x = first.x; x < last.x; x++){
+                    int value = round(matrix[y][x].value);
+
+                    if(value == solidBlockID || (value <= 0 && !isFalling(x, y))) continue;
+
+                    olc::vf2d position = cellToScreen(olc::vi2d(x, y));
+                    int tint = compressionTint(matrix[y][x].value);
+
+                    //---Rendering falling liquid as full tile---
+                    if(isFalling(x, y)){
+                        DrawPartialDecal(position, decalSheet.get(), olc::vi2d(3, 0) * tileSize, tileSize, scale, olc::Pixel(tint, tint, tint, 200));
+
+                        continue;
+                    }
+                    //------
+
+                    //Tiles 0-3 are cells with 1, 2, 3 and at least 4 units of water
+                    int tile = std::min(value, 4) - 1;
+
+                    DrawPartialDecal(position, decalSheet.get(), olc::vi2d(tile, 0) * tileSize, tileSize, scale, olc::Pixel(tint, tint, tint));
+                }
+            }
+
+            clearFalling();
+        }
+
+        //From blue (0) through red to yellow (1)
+        olc::Pixel heatColor(float heat, uint8_t alpha){
+            heat = std::min(std::max(heat, 0.f), 1.f);
+
+            olc::Pixel color = heat < 0.5f
+                ? olc::PixelLerp(olc::BLUE, olc::RED, heat * 2)
+                : olc::PixelLerp(olc::RED, olc::YELLOW, heat * 2 - 1);
+
+            color.a = alpha;
+
+            return color;
+        }
+
+        olc::Pixel overlayColor(int x, int y, bool isStripeBorder){
+            const cell& currentCell = matrix[y][x];
+            const stripe& owner = stripes[rowStripes[y]];
+
+            switch((int)debugOverlay){
+                case overlay_flow:{
+                    float flow = fabs(currentCell.flow);
+
+                    if(flow < 1e-4f) return olc::BLANK;
+
+                    //From 0.0001 to 1 unit of water
+                    return heatColor((log10(flow) + 4) / 4, 160);
+                }
+                case overlay_falling:
+                    return isFalling(x, y) ? olc::Pixel(255, 255, 0, 160) : olc::BLANK;
+                case overlay_activity:
+                    if(isStripeBorder) return olc::Pixel(255, 255, 255, 120);
+                    if(currentCell.lake) return olc::Pixel(0, 0, 255, 120);
+                    if(currentCell.value > 0 && currentCell.value != solidBlockID){
+                        //Only full cells join lakes
+                        bool canJoinLake = currentCell.quietSteps >= settleSteps && currentCell.value >= maxWaterValue;
+
+                        return canJoinLake ? olc::Pixel(0, 255, 0, 120) : olc::Pixel(255, 0, 0, 120);
+                    }
+                    if(!owner.isActive) return olc::Pixel(128, 128, 128, 80);
+
+                    return olc::BLANK;
+                case overlay_stripeCost:{
+                    if(isStripeBorder) return olc::Pixel(255, 255, 255, 120);
+                    if(!owner.isActive) return olc::BLANK;
+
+                    return heatColor(maxStripeTime > 0 ? owner.time / maxStripeTime : 0, 120);
+                }
+                case overlay_threads:{
+                    if(isStripeBorder) return olc::Pixel(255, 255, 255, 120);
+                    if(!owner.isActive) return olc::BLANK;
+
+                    olc::Pixel color = threadColors[owner.thread % 8];
+                    color.a = 120;
+
+                    return color;
+                }
+            }
+
+            return olc::BLANK;
+        }
+
+        //Fills the overlay image, has to be called before drawMatrix(), which clears falling marks
+        void updateOverlay(){
+            if(debugOverlay == overlay_off) return;
+
+            rowStripes.assign(matrixSize.y, 0);
+            maxStripeTime = 0;
+
+            for(int i = 0; i < (int)stripes.size(); i++){
+                for(int y = stripes[i].top; y < stripes[i].bottom; y++){
+                    rowStripes[y] = i;
+                }
+
+                if(stripes[i].isActive) maxStripeTime = std::max(maxStripeTime, stripes[i].time);
+            }
+
+            float cellSize = cellScreenSize();
+            std::vector<int> columns(simulationSize.x);
+
+            for(int screenX = 0; screenX < simulationSize.x; screenX++){
+                columns[screenX] = (int)floor(cameraPosition.x + screenX / cellSize);
+            }
+
+            int previousY = -1;
+
+            for(int screenY = 0; screenY < simulationSize.y; screenY++){
+                int y = (int)floor(cameraPosition.y + screenY / cellSize);
+                //First screen row of the top row of a stripe
+                bool isStripeBorder = y != previousY && y > 0 && y < matrixSize.y && stripes[rowStripes[y]].top == y;
+
+                previousY = y;
+
+                for(int screenX = 0; screenX < simulationSize.x; screenX++){
+                    int x = columns[screenX];
+                    olc::Pixel pixel = olc::BLANK;
+
+                    if(x >= 0 && x < matrixSize.x && y >= 0 && y < matrixSize.y){
+                        pixel = overlayColor(x, y, isStripeBorder);
+                    }
+
+                    overlaySprite->SetPixel(screenX, screenY, pixel);
+                }
+            }
+
+            overlayDecal->Update();
+        }
+
+        void drawOverlay(){
+            if(debugOverlay == overlay_off) return;
+
+            DrawDecal({0, 0}, overlayDecal.get());
+        }
+
+        //Applies the tool to every cell covered by the brush moved from start to end, each cell once
+        void paintStroke(olc::vi2d startPosition, olc::vi2d endPosition, brushTools tool){
+            ThickLine::shapes shape = brushShape ? ThickLine::shape_round : ThickLine::shape_square;
+
+            ThickLine::rasterize(startPosition, endPosition, brushSize, shape, matrixSize, [this, tool](int y, int firstX, int lastX){
+                for(int x = firstX; x <= lastX; x++){
+                    wakeLakesAround(x, y);
+
+                    if(tool == tool_solid){
+                        matrix[y][x].value = solidBlockID;
+                        markSolidChanged(x, y);
+                    }
+                    else if(tool == tool_water){
+                        if(matrix[y][x].value != solidBlockID){
+                            matrix[y][x].value += maxWaterValue;
+                        }
+                        else{
+                            matrix[y][x].value = maxWaterValue;
+                            markSolidChanged(x, y);
+                        }
+                    }
+                    else{
+                        if(matrix[y][x].value == solidBlockID) markSolidChanged(x, y);
+
+                        matrix[y][x].value = 0;
+                    }
+
+                    updateMasks(x, y);
+                }
+            });
+        }
+
+        //Whether values or the selected option changed since the panel image was drawn
+        bool isPanelOutdated(){
+            if(shownOption != activeOption || (int)shownValues.size() != parametersAmount) return true;
+
+            for(int i = 0; i < parametersAmount; i++){
+                if(shownValues[i] != parametersToChange[i].value) return true;
+            }
+
+            return false;
+        }
+
+        //Draws text of the panel into its image
+        void renderPanel(){
+            olc::vi2d offset = {simulationSize.x, 0};
+            uint32_t scale = interfaceFactor;
+
+            SetDrawTarget(panelSprite.get());
+            Clear(olc::BLACK);
+
             //---Simulation parameters---
-            DrawStringDecal(panelPositions.firstHeader, "--Simulation parameters--", olc::WHITE, {interfaceFactor, interfaceFactor});
+            DrawString(panelPositions.firstHeader - offset, "--Simulation parameters--", olc::WHITE, scale);
 
-            for(int i = 0; i < parametersAmount - graphicParameters; i++){                
+            for(int i = 0; i < parametersAmount - graphicParameters; i++){
                 std::string label = parametersToChange[i].label;
 
-                DrawStringDecal(panelPositions.labels[i], label + formatNumber(parametersToChange[i]), panelColors[activeOption == i], {interfaceFactor, interfaceFactor});
+                DrawString(panelPositions.labels[i] - offset, label + formatNumber(parametersToChange[i]), panelColors[activeOption == i], scale);
             }
             //------
 
-            DrawStringDecal(panelPositions.secondHeader, "--Graphic parameters--", olc::WHITE, {interfaceFactor, interfaceFactor});
-            
+            DrawString(panelPositions.secondHeader - offset, "--Graphic parameters--", olc::WHITE, scale);
+
             //---Graphic parameters---
             for(int i = parametersAmount - graphicParameters; i < parametersAmount; i++){
-                float number = parametersToChange[i].value;
-                char precision = 4;
-
-                if(parametersToChange[i].type == par_int){
-                    number = (int)number;
-                    precision = 0;
-                }
-                
                 std::string label = parametersToChange[i].label;
 
-                DrawStringDecal(panelPositions.labels[i], label + formatNumber(parametersToChange[i]), panelColors[activeOption == i], {interfaceFactor, interfaceFactor});
+                DrawString(panelPositions.labels[i] - offset, label + formatNumber(parametersToChange[i]), panelColors[activeOption == i], scale);
             }
             //------
+
+            SetDrawTarget(nullptr);
+            panelDecal->Update();
+
+            shownOption = activeOption;
+            shownValues.resize(parametersAmount);
+
+            for(int i = 0; i < parametersAmount; i++){
+                shownValues[i] = parametersToChange[i].value;
+            }
+        }
+
+        //Text changes only on key presses, so it's drawn into an image only then, the image is drawn every frame
+        void drawPanel(){
+            if(isPanelOutdated()) renderPanel();
+
+            DrawDecal({(float)simulationSize.x, 0}, panelDecal.get());
         }
 
-        olc::vi2d firstPosition = {-1, -1};
+        //Turns values gathered since the last refresh into lines of text
+        void updateProfiler(float fElapsedTime){
+            profilerTimer += fElapsedTime;
+
+            if(profilerTimer < profilerInterval) return;
+
+            int activeStripes = 0;
+
+            for(const stripe& currentStripe : stripes){
+                activeStripes += currentStripe.isActive;
+            }
+
+            std::stringstream stepTimeLine;
+            stepTimeLine << "Step: " << std::fixed << std::setprecision(3) << (profiledSteps ? profiledStepTime / profiledSteps : 0) << " ms";
+
+            std::stringstream latencyLine;
+            latencyLine << "Input latency: ";
+
+            if(profiledLatencies) latencyLine << std::fixed << std::setprecision(1) << profiledLatency / profiledLatencies << " ms (max " << profiledLatencyMax << ")";
+            else latencyLine << "-";
+
+            std::stringstream imbalanceLine;
+            imbalanceLine << "Imbalance: " << std::fixed << std::setprecision(2) << (profiledBusyMean > 0 ? profiledBusyMax / profiledBusyMean : 1);
+
+            BlockPool::statistics poolStatistics = blockPool->getStatistics();
+
+            profilerLines = {
+                "FPS: " + std::to_string(GetFPS()),
+                stepTimeLine.str(),
+                "Threads: " + std::to_string(scheduler->threadsAmount()),
+                "Stripes: " + std::to_string(activeStripes) + "/" + std::to_string(stripes.size()),
+                imbalanceLine.str(),
+                isSettled() ? "Settled after " + std::to_string(settledStep) + " steps" : "Moving",
+                "Blocks: " + std::to_string(poolStatistics.live) + "/" + std::to_string(poolStatistics.peak) + " free " + std::to_string(poolStatistics.free),
+                latencyLine.str()
+            };
+
+            renderProfiler();
+
+            profilerTimer = 0;
+            profiledLatency = 0;
+            profiledLatencyMax = 0;
+            profiledLatencies = 0;
+            profiledStepTime = 0;
+            profiledSteps = 0;
+            profiledBusyMax = 0;
+            profiledBusyMean = 0;
+        }
+
+        //Draws lines into the image of the profiler, only when they were refreshed
+        void renderProfiler(){
+            olc::vi2d position = {2 * (int)interfaceFactor, 2 * (int)interfaceFactor};
+            int lineHeight = 10 * interfaceFactor;
+            olc::vi2d size = {120 * (int)interfaceFactor, (int)profilerLines.size() * lineHeight + 4 * (int)interfaceFactor};
+
+            if(!profilerSprite || profilerSprite->width != size.x || profilerSprite->height != size.y){
+                profilerSprite = std::make_unique<olc::Sprite>(size.x, size.y);
+                profilerDecal = std::make_unique<olc::Decal>(profilerSprite.get());
+            }
+
+            SetDrawTarget(profilerSprite.get());
+            Clear(olc::Pixel(0, 0, 0, 160));
+
+            for(std::string& line : profilerLines){
+                DrawString(position, line, olc::YELLOW, interfaceFactor);
+                position.y += lineHeight;
+            }
+
+            SetDrawTarget(nullptr);
+            profilerDecal->Update();
+        }
+
+        void drawProfiler(){
+            if(profilerDecal) DrawDecal({0, 0}, profilerDecal.get());
+        }
+
+        //Updates averaged costs with measurements of the last frame
+        //and chooses number of steps for the next one
+        void tuneStepsPerFrame(float frameTime, float simulationTime, int steps){
+            if(steps > 0){
+                float lastStepTime = simulationTime / steps;
+
+                stepTime = stepTime == 0 ? lastStepTime : stepTime + (lastStepTime - stepTime) * timeSmoothing;
+            }
+
+            float lastOverhead = std::max(frameTime - simulationTime, 0.f);
+            frameOverhead += (lastOverhead - frameOverhead) * timeSmoothing;
+
+            if(!autoSteps || stepTime <= 0) return;
+
+            float target = (frameBudget - frameOverhead) / stepTime;
+            target = std::min(std::max(target, 1.f), (float)maxAutoSteps);
+
+            //Small differences are ignored, so the value doesn't jump between neighbouring numbers every frame
+            if(fabs(target - stepsPerFrame) > std::max(1.f, stepsPerFrame * stepsHysteresis)){
+                stepsPerFrame = (int)target;
+            }
+        }
+
+        //Frame rate allowed in the current state of the window, 0 means no limit
+        float chooseFrameRate(){
+            float frameRate = maxFrameRate;
+
+            auto limit = [&frameRate](float rate){
+                frameRate = frameRate > 0 ? std::min(frameRate, rate) : rate;
+            };
+
+            if(isIdle) limit(idleFrameRate);
+            if(!IsFocused()) limit(unfocusedFrameRate);
+
+            return frameRate;
+        }
+
+        //Steps of the current frame, more than stepsPerFrame when frames are slowed down below the rate
+        //they would have otherwise: maxFrameRate or, without a limit, the rate measured frames can be made at
+        int chooseSteps(){
+            float nominalFrameRate = maxFrameRate;
+
+            if(nominalFrameRate <= 0){
+                float frameTime = frameOverhead + stepsPerFrame * stepTime;
+
+                nominalFrameRate = frameTime > 0 ? 1000.f / frameTime : 0;
+            }
+
+            if(nominalFrameRate <= 0 || targetFrameRate <= 0 || targetFrameRate >= nominalFrameRate) return stepsPerFrame;
+
+            return std::min(stepsPerFrame * nominalFrameRate / targetFrameRate, (float)maxAutoSteps);
+        }
+
+        //Sleeps until 1 / targetFrameRate seconds passed since the start of the previous frame
+        void paceFrame(){
+            auto now = std::chrono::steady_clock::now();
+            lastSleepTime = 0;
+
+            if(targetFrameRate > 0){
+                auto frameStart = lastFrameStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.f / targetFrameRate));
+
+                if(frameStart > now){
+                    std::this_thread::sleep_until(frameStart);
+
+                    lastSleepTime = std::chrono::duration<float, std::milli>(frameStart - now).count();
+                    now = std::chrono::steady_clock::now();
+                }
+            }
+
+            lastFrameStart = now;
+        }
+
+        //Screen position is inside the simulation area, not on the panel
+        bool isInSimulationArea(olc::vi2d position){
+            return position.x >= 0 && position.y >= 0 && position.x < simulationSize.x && position.y < simulationSize.y;
+        }
+
+        //True if a mouse button that edits cells is held over the simulation area
+        //Left button only places points of the line in Draw lines mode, cells change on its click
+        bool isEditingCells(){
+            if(!isInSimulationArea(GetMousePos())) return false;
+
+            return (GetMouse(0).bHeld && !drawLines) || GetMouse(1).bHeld || GetMouse(2).bHeld;
+        }
+
+        //Limits steps of frames with edits in low latency mode, steps left out are added to the next frames,
+        //at most doubling them, so frames after the stroke don't take much longer
+        int latencySteps(int steps, bool isEditing){
+            if(!lowLatency){
+                deferredSteps = 0;
+
+                return steps;
+            }
+
+            if(isEditing){
+                int allowed = stepTime > 0 ? std::max((int)(latencyBudget / stepTime), 1) : 1;
+
+                if(steps <= allowed) return steps;
+
+                deferredSteps = std::min(deferredSteps + steps - allowed, maxAutoSteps);
+
+                return allowed;
+            }
+
+            int caughtUp = std::min(deferredSteps, steps);
+            deferredSteps -= caughtUp;
+
+            return steps + caughtUp;
+        }
+
+        //Outline of the cells the brush would change, drawn from input of the current frame
+        //Square brush gets a square, round one a circle with the radius of its capsule
+        void drawBrushPreview(){
+            olc::vi2d position = GetMousePos();
+
+            if(!lowLatency || !isInSimulationArea(position)) return;
+
+            position = screenToCell(position);
+
+            int left = position.x - ThickLine::brushOffset(brushSize);
+            int up = position.y - ThickLine::brushOffset(brushSize);
+
+            olc::vf2d topLeft = cellToScreen(olc::vf2d(left, up));
+            olc::vf2d bottomRight = cellToScreen(olc::vf2d(left + brushSize + 1, up + brushSize + 1));
+
+            if(brushShape){
+                const int segments = 32;
+                //M_PI isn't defined by every compiler in standard mode
+                constexpr float pi = 3.14159265f;
+
+                olc::vf2d centre = (topLeft + bottomRight) / 2;
+                float radius = (bottomRight.x - topLeft.x) / 2;
+
+                for(int i = 0; i < segments; i++){
+                    float angle = 2 * pi * i / segments;
+                    float nextAngle = 2 * pi * (i + 1) / segments;
+
+                    DrawLineDecal(centre + olc::vf2d(cos(angle), sin(angle)) * radius, centre + olc::vf2d(cos(nextAngle), sin(nextAngle)) * radius, olc::WHITE);
+                }
+
+                return;
+            }
+
+            DrawLineDecal(topLeft, {bottomRight.x, topLeft.y}, olc::WHITE);
+            DrawLineDecal({bottomRight.x, topLeft.y}, bottomRight, olc::WHITE);
+            DrawLineDecal(bottomRight, {topLeft.x, bottomRight.y}, olc::WHITE);
+            DrawLineDecal({topLeft.x, bottomRight.y}, topLeft, olc::WHITE);
+        }
+
+        //True if any key or mouse button is held or the mouse moved since the last frame
+        bool hasUserInput(){
+            olc::vi2d mousePosition = GetMousePos();
+            bool hasMoved = mousePosition != lastMousePosition;
+
+            lastMousePosition = mousePosition;
+
+            if(hasMoved || GetMouseWheel() != 0) return true;
+
+            for(int button = 0; button < 3; button++){
+                if(GetMouse(button).bHeld || GetMouse(button).bReleased) return true;
+            }
+
+            for(int key = olc::Key::NONE + 1; key < olc::Key::ENUM_END; key++){
+                if(GetKey((olc::Key)key).bHeld || GetKey((olc::Key)key).bReleased) return true;
+            }
+
+            return false;
+        }
+
+        //First point of the line, empty until it's set
+        std::optional<olc::vi2d> firstPosition;
+
+        //Cell under the cursor in the previous frame of the stroke of every button, empty if the button isn't drawing
+        //Camera can show cells outside of the matrix, so no position can mean "none"
+        std::optional<olc::vi2d> strokePositions[3];
         void handleUserInput(){
             //---Reset matrix on R press---
             if(GetKey(olc::Key::R).bPressed){
                 initializeMatrix();
+
+                for(solidChunk& chunk : solidChunks){
+                    chunk.isDirty = true;
+                }
+            }
+            //------
+
+            //---Toggle profiler on F1 press---
+            if(GetKey(olc::Key::F1).bPressed){
+                showProfiler = !showProfiler;
+                setProfiled(showProfiler);
             }
             //------
 
@@ -301,6 +1121,8 @@ class LiquidSimulator : public olc::PixelGameEngine{
                 for(int i = 0; i < parametersAmount; i++){
                     parametersToChange[i].resetValue();
                 }
+
+                disturb();
             }
             //------
 
@@ -330,106 +1152,73 @@ class LiquidSimulator : public olc::PixelGameEngine{
 
                 if(GetKey(olc::Key::LEFT).bPressed) parametersToChange[activeOption].decrease();
             }
+
+            //New parameters can move settled water
+            if(GetKey(olc::Key::RIGHT).bHeld || GetKey(olc::Key::LEFT).bHeld) disturb();
             //------
 
             //---Drawing tiles---
-            //Draw solid tile
+            //Draw solid line
             if(drawLines){
                 if(GetMouse(0).bPressed){
-                    //Setting first point
-                    if(firstPosition == olc::vi2d(-1, -1)){
-                        olc::vi2d position = {GetMouseX(), GetMouseY()};
-
-                        if(position.x <= simulationSize.x && position.y <= simulationSize.y){
-                            firstPosition = position / tileSize;
-                        }
-                    }
-                    else{
-                        olc::vi2d position = {GetMouseX(), GetMouseY()};
-
-                        if(position.x <= simulationSize.x && position.y <= simulationSize.y){
-                            position /= tileSize;
-
-                            drawMatrixLine(firstPosition, position);
-
-                            firstPosition = {-1, -1};
-                        }  
-                    }
-                }
-            }
-            else{
-                if(GetMouse(0).bHeld){
                     olc::vi2d position = {GetMouseX(), GetMouseY()};
-                    if(position.x <= simulationSize.x && position.y <= simulationSize.y){
-                        position /= tileSize;
 
-                        int left = position.x - (brushSize / 2);
-                        int up = position.y - (brushSize / 2);
+                    if(isInSimulationArea(position)){
+                        //Setting first point
+                        if(!firstPosition){
+                            firstPosition = screenToCell(position);
+                        }
+                        else{
+                            paintStroke(*firstPosition, screenToCell(position), tool_solid);
 
-                        for(int i = left; i <= left + brushSize; i++){
-                            for(int j = up; j <= up + brushSize; j++){
-                                if(getNeighbour({i, j}, {0, 0}) != -1){
-                                    matrix[j][i].value = solidBlockID;
-                                }
-                            }
+                            firstPosition.reset();
                         }
                     }
                 }
             }
 
-            //Draw water tile
-            if(GetMouse(1).bHeld){
-                olc::vi2d position = {GetMouseX(), GetMouseY()};
-                if(position.x <= simulationSize.x && position.y <= simulationSize.y){
-
-                    position /= tileSize;
+            //Brushes are moved from the cell under the cursor in the previous frame,
+            //so fast strokes leave no gaps. Every held button draws with its own tool
+            olc::vi2d position = {GetMouseX(), GetMouseY()};
 
-                    int left = position.x - (brushSize / 2);
-                    int up = position.y - (brushSize / 2);
+            //Left - solid blocks, right - water, middle - removing
+            const brushTools tools[3] = {tool_solid, tool_water, tool_erase};
 
-                    for(int i = left; i <= left + brushSize; i++){
-                        for(int j = up; j <= up + brushSize; j++){
-                            if(getNeighbour({i, j}, {0, 0}) != -1){
+            for(int button = 0; button < 3; button++){
+                bool isDrawing = GetMouse(button).bHeld && !(button == 0 && drawLines) && isInSimulationArea(position);
 
-                                if(matrix[j][i].value != solidBlockID){
-                                    matrix[j][i].value += maxWaterValue;
-                                }
-                                else{
-                                    matrix[j][i].value = maxWaterValue;
-                                }
-                            }
-                        }
-                    }
+                if(!isDrawing){
+                    strokePositions[button].reset();
+                    continue;
                 }
-            }
-        
-            //Remove tile
-            if(GetMouse(2).bHeld){
-                olc::vi2d position = {GetMouseX(), GetMouseY()};
-                if(position.x <= simulationSize.x && position.y <= simulationSize.y){
-                    position /= tileSize;
 
-                    int left = position.x - (brushSize / 2);
-                    int up = position.y - (brushSize / 2);
+                olc::vi2d cellPosition = screenToCell(position);
 
-                    for(int i = left; i <= left + brushSize; i++){
-                        for(int j = up; j <= up + brushSize; j++){
-                            if(getNeighbour({i, j}, {0, 0}) != -1){
-                                matrix[j][i].value = 0;
-                            }
-                        }
-                    }
-                }
+                if(!strokePositions[button]) strokePositions[button] = cellPosition;
+
+                paintStroke(*strokePositions[button], cellPosition, tools[button]);
+
+                strokePositions[button] = cellPosition;
             }
             //------
         }
 
     public:
+        //Reads optional settings of the window and of the simulation
+        void loadSettings(const nlohmann::json& config){
+            LiquidSimulation::loadSettings(config);
+
+            idleFrameRate = std::max(config.value("idleFrameRate", idleFrameRate), 1.f);
+            maxFrameRate = std::max(config.value("maxFrameRate", maxFrameRate), 0.f);
+            unfocusedFrameRate = std::max(config.value("unfocusedFrameRate", unfocusedFrameRate), 0.1f);
+            latencyBudget = std::max(config.value("latencyBudget", latencyBudget), 0.f);
+            worldSize = {config.value("worldWidth", 0), config.value("worldHeight", 0)};
+        }
+
         bool OnUserCreate() override{
             //---Calculate sizes---
             panelSize = {int((float)ScreenWidth() * (panelWidthPercent / 100.f)), ScreenHeight()};
             simulationSize = olc::vi2d(ScreenWidth() - panelSize.x, ScreenHeight());
-            matrixSize = simulationSize / tileSize;
 
             interfaceFactor = ScreenHeight() / 360;
 
@@ -443,23 +1232,83 @@ class LiquidSimulator : public olc::PixelGameEngine{
             //------
 
             //Load sprite sheet
-            std::unique_ptr<olc::Sprite> spriteSheet = std::make_unique<olc::Sprite>("./Sprites/tiles.png");
+            spriteSheet = std::make_unique<olc::Sprite>("./Sprites/tiles.png");
             decalSheet = std::make_unique<olc::Decal>(spriteSheet.get());
 
-            //---Initialization of cellular automaton matrix---
-            initializeMatrix();
-            //------
+            //Starts threads and creates the matrix
+            olc::vi2d size = simulationSize / tileSize;
+
+            if(worldSize.x > 0) size.x = worldSize.x;
+            if(worldSize.y > 0) size.y = worldSize.y;
+
+            create(size);
+
+            createSolidLayer();
+
+            lodSprite = std::make_unique<olc::Sprite>(simulationSize.x, simulationSize.y);
+            lodDecal = std::make_unique<olc::Decal>(lodSprite.get());
+
+            overlaySprite = std::make_unique<olc::Sprite>(simulationSize.x, simulationSize.y);
+            overlayDecal = std::make_unique<olc::Decal>(overlaySprite.get());
+
+            panelSprite = std::make_unique<olc::Sprite>(panelSize.x, panelSize.y);
+            panelDecal = std::make_unique<olc::Decal>(panelSprite.get());
+
+            //Full water and solid tiles
+            waterColor = averageColor({3, 0});
+            solidColor = averageColor({4, 0});
 
             return true;
         }
 
         bool OnUserUpdate(float fElapsedTime) override{
+            //Input was polled just before, and the previous frame was presented
+            auto frameStart = std::chrono::steady_clock::now();
+
+            if(isLatencyMeasured){
+                float latency = std::chrono::duration<float, std::milli>(frameStart - inputTime).count();
+
+                profiledLatency += latency;
+                profiledLatencyMax = std::max(profiledLatencyMax, latency);
+                profiledLatencies++;
+
+                isLatencyMeasured = false;
+            }
+
+            //Elapsed time covers the previous frame, so it's compared with simulation time of that frame
+            //Idle frame is mostly sleeping, so it says nothing about costs
+            if(!isIdle) tuneStepsPerFrame(fElapsedTime * 1000.f - lastSleepTime, lastSimulationTime, lastSteps);
+
+            //Waiting here doesn't delay showing the previous frame, it's already presented
+            //Input was polled before the wait, so latency of edits is measured from frameStart
+            paceFrame();
+
+            updateCamera(fElapsedTime);
             handleUserInput();
 
+            bool isEditing = isEditingCells();
+
+            if(isEditing){
+                inputTime = frameStart;
+                isLatencyMeasured = true;
+            }
+
+            //---Idle mode---
+            isIdle = isSettled() && !hasUserInput();
+
+            if(isSettled() && settledStep != reportedSettledStep){
+                std::cout << "Settled after " << settledStep << " steps" << std::endl;
+
+                reportedSettledStep = settledStep;
+            }
+            //------
+
+            targetFrameRate = chooseFrameRate();
+
             Clear(olc::BLACK);
 
-            if(firstPosition != olc::vi2d(-1, -1)){
-                olc::vi2d pos1 = firstPosition * tileSize;
+            if(firstPosition){
+                olc::vi2d pos1 = cellToScreen(*firstPosition);
 
                 FillCircle(pos1, 6, olc::RED);
 
@@ -468,164 +1317,362 @@ class LiquidSimulator : public olc::PixelGameEngine{
                 DrawLineDecal(pos1, pos2, olc::RED);
             }
 
-            for(int i = 0; i < (int)stepsPerFrame; i++){
-                //---Simulation step---
-                for(int y = matrixSize.y - 1; y >= 0; y--){
-                    for(int x = matrixSize.x - 1; x >= 0; x--){
-                        float& currentCell = matrix[y][x].value;
-                        //matrix[y][x].isFalling = false;
+            //Settled matrix doesn't change until the user changes it
+            lastSteps = isSettled() ? 0 : latencySteps(chooseSteps(), isEditing);
+            auto simulationStart = std::chrono::steady_clock::now();
 
-                        //Skipping blocks that are not water
-                        if(currentCell == -1 || currentCell == solidBlockID) continue;
+            for(int i = 0; i < lastSteps; i++){
+                simulationStep();
+            }
 
-                        //---Values of current cell neighbours---
-                        float upperCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(0, -1));
-                        float bottomCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(0, 1));
-                        float leftCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(-1, 0));
-                        float rightCell = getNeighbour(olc::vi2d(x, y), olc::vi2d(1, 0));
-                        //------
+            lastSimulationTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - simulationStart).count();
 
-                        //---Falling down---
-                        if(currentCell > 0 && bottomCell != -1 && bottomCell != solidBlockID){
-                            float waterToFlow = waterFlowDown(currentCell, bottomCell);
+            //---Rendering matrix---
+            updateOverlay();
+            drawMatrix();
+            drawOverlay();
+            drawBrushPreview();
 
-                            //Instead of instant transfering water
-                            //we do it partialy to create smooth transition
-                            if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+            //------
 
-                            matrix[y][x].value -= waterToFlow;
-                            matrix[y + 1][x].value += waterToFlow;
+            //---Draw panel---
+            //Its image has black background, which also covers cells outside of the simulation area
+            drawPanel();
+            //------
 
+            updateProfiler(fElapsedTime);
 
-                            if(waterToFlow > 0.1) matrix[y + 1][x].isFalling = true;
-                        }
+            if(showProfiler) drawProfiler();
 
-                        //---Spilling to left---
-                        if(currentCell > 0 && leftCell != -1 && leftCell != solidBlockID){
-                            if(leftCell < currentCell){
+            return true;
+        }
 
-                                float waterToFlow = (currentCell - leftCell) / 4.f;
+};
 
-                                //Instead of instant transfering water
-                                //we do it partialy to create smooth transition
-                                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+//Use dedicated GPU
+extern "C"{
+  __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
+}
 
-                                matrix[y][x].value -= waterToFlow;
-                                matrix[y][x - 1].value += waterToFlow;
-                            }     
-                        }
-                        //------
+//Reads "--name value" pairs of command line arguments, names are stored without dashes
+std::map<std::string, std::string> readArguments(int argc, char* argv[]){
+    std::map<std::string, std::string> arguments;
 
-                        //---Spilling to right---
-                        if(currentCell > 0 && rightCell != -1 && rightCell != solidBlockID){
-                            if(rightCell < currentCell){
+    for(int i = 1; i < argc; i++){
+        std::string name = argv[i];
 
-                                float waterToFlow = (currentCell - rightCell) / 4.f;
-                                if(waterToFlow > minFlow) waterToFlow /= flowDivider;
-                                
-                                matrix[y][x].value -= waterToFlow;
-                                matrix[y][x + 1].value += waterToFlow;
-                            }
-                        }
-                        //------
+        if(name.rfind("--", 0) != 0) continue;
 
-                        //---Going up---
-                        if(currentCell > 0 && upperCell != -1 && upperCell != solidBlockID){
+        bool hasValue = i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0;
 
-                            float waterToFlow = waterFlowUp(currentCell, upperCell);
+        arguments[name.substr(2)] = hasValue ? argv[++i] : "";
+    }
 
-                            //Instead of instant transfering water
-                            //we do it partialy to create smooth transition
-                            if(waterToFlow > minFlow) waterToFlow /= flowDivider;
+    return arguments;
+}
 
-                            matrix[y][x].value -= waterToFlow;
-                            matrix[y - 1][x].value += waterToFlow;
-                        }
-                        //------
-                    }
-                }
-                //------
-            }
+//Reads "low:high" or a single value, which is both ends of the range
+void readRange(const std::string& text, float& low, float& high){
+    size_t separator = text.find(':');
 
-            //---Rendering matrix---
-            for(int y = 0; y < matrixSize.y; y++){
-                for(int x = 0; x < matrixSize.x; x++){
-                    int value = round(matrix[y][x].value);
+    low = std::stof(text.substr(0, separator));
+    high = separator == std::string::npos ? low : std::stof(text.substr(separator + 1));
+}
 
-                    if(value == solidBlockID){
-                        DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(4, 0) * tileSize, tileSize);
+//Reads "low:high:step" or a single value into the list of values from low to high
+std::vector<float> readSweepRange(const std::string& text){
+    size_t first = text.find(':');
+    size_t second = first == std::string::npos ? std::string::npos : text.find(':', first + 1);
 
-                        continue;
-                    }
+    float low = std::stof(text.substr(0, first));
 
-                    float compression = matrix[y][x].value - (float)maxWaterValue;
-                    int tint = 255;
+    if(second == std::string::npos) return {low};
 
-                    //Interpolate compression to value between 255 (no change) and 64 (dark)
-                    if(value != solidBlockID && compression > 0){
-                        tint = -191.f/(float)(2 * maxWaterValue) * compression + 255.f;
+    float high = std::stof(text.substr(first + 1, second - first - 1));
+    float step = std::stof(text.substr(second + 1));
 
-                        if(tint < 64) tint = 64;
-                    }
+    std::vector<float> values;
 
-                    //---Rendering falling liquid as full tile---
-                    if(matrix[y][x].isFalling){
-                        DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(3, 0) * tileSize, tileSize, {(1.f), (1.f)}, olc::Pixel(tint, tint, tint, 200));
+    //Small margin, so high is not lost to rounding of repeated adding
+    for(int i = 0; step > 0 && low + i * step <= high + step * 0.001f; i++){
+        values.push_back(low + i * step);
+    }
 
-                        matrix[y][x].isFalling = false;
-                        continue;
-                    }
-                    //------
+    return values;
+}
+
+//Reads the starting state given with --map, or makes the default one
+//Size is taken from --size, or from the map file, or 64x64
+std::vector<std::string> readMap(std::map<std::string, std::string>& arguments, olc::vi2d& size){
+    std::vector<std::string> map;
+    size = {64, 64};
+
+    if(arguments.count("map")){
+        std::ifstream mapFile(arguments["map"]);
+        std::string row;
+
+        while(std::getline(mapFile, row)){
+            map.push_back(row);
+        }
 
-                    switch(value){
-                        case 0:
-                            break;
+        size = {0, (int)map.size()};
 
-                        case 1:
-                            // DrawPartialSprite(olc::vi2d(x, y) * tileSize, spriteSheet.get(), olc::vi2d(0, 0) * tileSize, tileSize);
+        for(std::string& mapRow : map){
+            size.x = std::max(size.x, (int)mapRow.size());
+        }
+    }
 
-                            DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(0, 0) * tileSize, tileSize, {(1.f), (1.f)}, olc::Pixel(tint, tint, tint));
-                            break;
+    if(arguments.count("size")){
+        std::string text = arguments["size"];
+        size_t separator = text.find('x');
+
+        size = {std::stoi(text.substr(0, separator)), std::stoi(text.substr(separator + 1))};
+    }
 
-                        case 2:
-                            // DrawPartialSprite(olc::vi2d(x, y) * tileSize, spriteSheet.get(), olc::vi2d(1, 0) * tileSize, tileSize);
+    if(map.empty()) map = EnsembleRunner::damBreakMap(size);
 
-                            DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(1, 0) * tileSize, tileSize, {(1.f), (1.f)}, olc::Pixel(tint, tint, tint));
+    return map;
+}
 
-                            break;
+int readThreadsAmount(const nlohmann::json& config){
+    int threadsAmount = config.value("threads", 0);
 
-                        case 3:
-                            // DrawPartialSprite(olc::vi2d(x, y) * tileSize, spriteSheet.get(), olc::vi2d(2, 0) * tileSize, tileSize);
-                            
-                            DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(2, 0) * tileSize, tileSize, {(1.f), (1.f)}, olc::Pixel(tint, tint, tint));
+    if(threadsAmount <= 0) threadsAmount = std::max(1u, std::thread::hardware_concurrency());
 
-                            break;
+    return threadsAmount;
+}
 
-                        default:
-                            // DrawPartialSprite(olc::vi2d(x, y) * tileSize, spriteSheet.get(), olc::vi2d(3, 0) * tileSize, tileSize);
-                            
-                            DrawPartialDecal(olc::vi2d(x, y) * tileSize, decalSheet.get(), olc::vi2d(3, 0) * tileSize, tileSize, {(1.f), (1.f)}, olc::Pixel(tint, tint, tint));
+//Runs simulations given with --ensemble without a window and prints a CSV line with summary of each one
+//Compression and flow divider ranges are spread evenly across simulations
+void runEnsemble(std::map<std::string, std::string>& arguments, const nlohmann::json& config){
+    int amount = std::max(std::stoi(arguments["ensemble"]), 1);
+    int steps = arguments.count("steps") ? std::stoi(arguments["steps"]) : 1000;
 
-                            break;
-                    }
-                }
+    float compression[2] = {0.4, 0.4};
+    float flowDivider[2] = {1, 1};
+
+    if(arguments.count("compression")) readRange(arguments["compression"], compression[0], compression[1]);
+    if(arguments.count("flowDivider")) readRange(arguments["flowDivider"], flowDivider[0], flowDivider[1]);
+
+    olc::vi2d size;
+    std::vector<std::string> map = readMap(arguments, size);
+
+    int threadsAmount = readThreadsAmount(config);
+
+    enableFlushToZero();
+    TaskScheduler scheduler(threadsAmount, enableFlushToZero);
+
+    std::vector<EnsembleRunner::member> members(amount);
+
+    for(int i = 0; i < amount; i++){
+        float position = amount > 1 ? (float)i / (amount - 1) : 0;
+
+        members[i] = {
+            compression[0] + (compression[1] - compression[0]) * position,
+            std::max(flowDivider[0] + (flowDivider[1] - flowDivider[0]) * position, 1.f),
+            1,
+            steps,
+            false
+        };
+    }
+
+    EnsembleRunner runner(scheduler, config, size, map);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<EnsembleRunner::summary> summaries = runner.run(members);
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "member,compression,flowDivider,steps,timeMs,water,removedMass,liquidCells,lakeCells,lakes" << std::endl;
+
+    for(int i = 0; i < amount; i++){
+        const EnsembleRunner::summary& current = summaries[i];
+
+        std::cout << i << "," << current.settings.compression << "," << current.settings.flowDivider << "," << current.settings.steps << ","
+            << current.time << "," << current.statistics.water << "," << current.statistics.removedMass << ","
+            << current.statistics.liquidCells << "," << current.statistics.lakeCells << "," << current.statistics.lakes << std::endl;
+    }
+
+    //Kept out of the CSV output
+    double stepsPerSecond = (double)amount * steps / time;
+
+    std::cerr << amount << " simulations of " << size.x << "x" << size.y << " on " << threadsAmount << " threads: " << time << " s, "
+        << stepsPerSecond << " steps/s, " << stepsPerSecond / threadsAmount << " steps/s per thread" << std::endl;
+}
+
+//Runs every combination of parameter values given with --sweep on one map, each until it settles,
+//and writes results to --output (JSON when its name ends with .json, CSV otherwise) or to the standard output
+void runSweep(std::map<std::string, std::string>& arguments, const nlohmann::json& config){
+    int steps = arguments.count("steps") ? std::stoi(arguments["steps"]) : 20000;
+
+    std::vector<float> compressions = readSweepRange(arguments.count("compression") ? arguments["compression"] : "0.4");
+    std::vector<float> flowDividers = readSweepRange(arguments.count("flowDivider") ? arguments["flowDivider"] : "1");
+    std::vector<float> stepsPerFrames = readSweepRange(arguments.count("stepsPerFrame") ? arguments["stepsPerFrame"] : "5");
+
+    olc::vi2d size;
+    std::vector<std::string> map = readMap(arguments, size);
+
+    int threadsAmount = readThreadsAmount(config);
+
+    enableFlushToZero();
+    TaskScheduler scheduler(threadsAmount, enableFlushToZero);
+
+    std::vector<EnsembleRunner::member> members;
+
+    for(float compression : compressions){
+        for(float flowDivider : flowDividers){
+            for(float stepsPerFrame : stepsPerFrames){
+                members.push_back({compression, std::max(flowDivider, 1.f), std::max((int)stepsPerFrame, 1), steps, true});
             }
-            //------
+        }
+    }
 
-            //---Draw panel---
-            drawPanel();
-            //------
-            return true;
+    EnsembleRunner runner(scheduler, config, size, map);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<EnsembleRunner::summary> summaries = runner.run(members);
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string outputName = arguments.count("output") ? arguments["output"] : "";
+    bool isJson = outputName.size() >= 5 && outputName.compare(outputName.size() - 5, 5, ".json") == 0;
+
+    std::ofstream outputFile;
+
+    if(!outputName.empty()) outputFile.open(outputName);
+
+    std::ostream& output = outputName.empty() ? std::cout : outputFile;
+    nlohmann::json results = nlohmann::json::array();
+
+    if(!isJson){
+        output << "compression,flowDivider,stepsPerFrame,settled,settleSteps,settleFrames,steps,timeMs,stepsPerSecond,"
+            << "water,lakeWater,removedMass,liquidCells,lakeCells,lakes,massCentreY" << std::endl;
+    }
+
+    int unsettledAmount = 0;
+
+    for(const EnsembleRunner::summary& current : summaries){
+        bool isSettled = current.settledStep >= 0;
+        if(!isSettled) unsettledAmount++;
+
+        double stepsPerSecond = current.time > 0 ? current.stepsDone / current.time * 1000 : 0;
+
+        //Row of the centre of mass, grows as water goes down
+        double massCentreY = 0;
+
+        for(int y = 0; y < (int)current.rowMass.size(); y++){
+            massCentreY += current.rowMass[y] * y;
         }
 
-};
+        if(current.statistics.water > 0) massCentreY /= current.statistics.water;
+
+        if(isJson){
+            results.push_back({
+                {"compression", current.settings.compression},
+                {"flowDivider", current.settings.flowDivider},
+                {"stepsPerFrame", current.settings.stepsPerFrame},
+                {"settled", isSettled},
+                //null rather than a number so unsettled runs can't be mistaken for fast ones
+                {"settleSteps", isSettled ? nlohmann::json(current.settledStep) : nlohmann::json()},
+                {"settleFrames", isSettled ? nlohmann::json(current.framesDone) : nlohmann::json()},
+                {"steps", current.stepsDone},
+                {"timeMs", current.time},
+                {"stepsPerSecond", stepsPerSecond},
+                {"water", current.statistics.water},
+                {"lakeWater", current.statistics.lakeWater},
+                {"removedMass", current.statistics.removedMass},
+                {"liquidCells", current.statistics.liquidCells},
+                {"lakeCells", current.statistics.lakeCells},
+                {"lakes", current.statistics.lakes},
+                {"massCentreY", massCentreY},
+                {"rowMass", current.rowMass}
+            });
+        }
+        else{
+            output << current.settings.compression << "," << current.settings.flowDivider << "," << current.settings.stepsPerFrame << ","
+                << (isSettled ? "yes" : "no") << ","
+                //Left empty for unsettled runs
+                << (isSettled ? std::to_string(current.settledStep) : "") << "," << (isSettled ? std::to_string(current.framesDone) : "") << ","
+                << current.stepsDone << ","
+                << current.time << "," << stepsPerSecond << "," << current.statistics.water << "," << current.statistics.lakeWater << ","
+                << current.statistics.removedMass << "," << current.statistics.liquidCells << "," << current.statistics.lakeCells << ","
+                << current.statistics.lakes << "," << massCentreY << std::endl;
+        }
+    }
 
-//Use dedicated GPU
-extern "C"{
-  __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;
+    if(isJson) output << results.dump(4) << std::endl;
+
+    std::cerr << members.size() << " combinations on " << threadsAmount << " threads: " << time << " s" << std::endl;
+
+    if(unsettledAmount > 0){
+        std::cerr << unsettledAmount << " of them didn't settle within " << steps << " steps" << std::endl;
+    }
 }
 
-int main(){
+//Runs one simulation given with --render without a window and draws every frame on the CPU
+//Frames are written by FrameExporter on its own threads (see --output in README)
+void runRender(std::map<std::string, std::string>& arguments, const nlohmann::json& config){
+    int frames = std::max(std::stoi(arguments["render"]), 1);
+    int stepsPerFrame = arguments.count("stepsPerFrame") ? std::stoi(arguments["stepsPerFrame"]) : 5;
+    int cellSize = arguments.count("cellSize") ? std::stoi(arguments["cellSize"]) : 4;
+    int encodeThreads = arguments.count("encodeThreads") ? std::stoi(arguments["encodeThreads"]) : 2;
+    float compression = arguments.count("compression") ? std::stof(arguments["compression"]) : 0.4;
+    float flowDivider = arguments.count("flowDivider") ? std::stof(arguments["flowDivider"]) : 1;
+    std::string output = arguments.count("output") ? arguments["output"] : "frame";
+
+    olc::vi2d size;
+    std::vector<std::string> map = readMap(arguments, size);
+
+    //Image loader of sprites is chosen by the constructor of the engine, no window is opened
+    olc::PixelGameEngine engine;
+    olc::Sprite spriteSheet("./Sprites/tiles.png");
+
+    if(spriteSheet.width == 0){
+        std::cerr << "Can't load ./Sprites/tiles.png" << std::endl;
+
+        return;
+    }
+
+    LiquidSimulation simulation;
+    simulation.loadSettings(config);
+    simulation.create(size, false);
+    simulation.setParameters(compression, std::max(flowDivider, 1.f));
+    simulation.loadMap(map);
+
+    SoftwareRenderer renderer(&spriteSheet, {4, 4}, cellSize);
+
+    //Every encoding thread can work on one frame while the simulation fills the next ones
+    FrameExporter exporter(output, encodeThreads, encodeThreads * 2 + 1);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(int frame = 0; frame < frames && !exporter.failed(); frame++){
+        for(int i = 0; i < stepsPerFrame; i++){
+            simulation.step();
+        }
+
+        FrameExporter::frame* image = exporter.acquire();
+
+        renderer.render(simulation, image->pixels);
+        image->width = renderer.getWidth();
+        image->height = renderer.getHeight();
+
+        exporter.submit(image);
+    }
+
+    double simulationTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    exporter.finish();
+
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long written = exporter.getWrittenFrames();
+
+    if(exporter.failed()) std::cerr << "Can't write frames to " << output << ", " << written << " of " << frames << " written" << std::endl;
+
+    std::cerr << written << " frames of " << renderer.getWidth() << "x" << renderer.getHeight() << " (RGBA): " << time << " s, "
+        << written / time << " frames/s, simulation waited for the output " << exporter.getWaitTime() << " s of " << simulationTime << " s" << std::endl;
+}
+
+int main(int argc, char* argv[]){
     //---Reading user setting from file---
     std::ifstream jsonFile("config.json");
     nlohmann::json configJson;
@@ -633,8 +1680,29 @@ int main(){
     jsonFile >> configJson;
     //------
 
+    std::map<std::string, std::string> arguments = readArguments(argc, argv);
+
+    if(arguments.count("ensemble")){
+        runEnsemble(arguments, configJson);
+
+        return 0;
+    }
+
+    if(arguments.count("sweep")){
+        runSweep(arguments, configJson);
+
+        return 0;
+    }
+
+    if(arguments.count("render")){
+        runRender(arguments, configJson);
+
+        return 0;
+    }
+
     //---Creating window and starting simulation---
     LiquidSimulator LS;
+    LS.loadSettings(configJson);
 
     if(LS.Construct(
             configJson["width"],
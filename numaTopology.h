@@ -0,0 +1,127 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//Returns CPUs of every NUMA node
+//If topology can't be read, all CPUs are treated as a single node
+inline std::vector<std::vector<int>> readNumaNodes(){
+    std::vector<std::vector<int>> nodes;
+
+    #if defined(_WIN32)
+    ULONG highestNode = 0;
+
+    if(GetNumaHighestNodeNumber(&highestNode)){
+        for(ULONG node = 0; node <= highestNode; node++){
+            ULONGLONG mask = 0;
+
+            if(!GetNumaNodeProcessorMask((UCHAR)node, &mask) || !mask) continue;
+
+            std::vector<int> cpus;
+
+            for(int cpu = 0; cpu < 64; cpu++){
+                if(mask & (ULONGLONG(1) << cpu)) cpus.push_back(cpu);
+            }
+
+            nodes.push_back(cpus);
+        }
+    }
+    #elif defined(__linux__)
+    //Every node has a list of its CPUs in form like "0-3,8-11"
+    for(int node = 0; ; node++){
+        std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+
+        if(!cpuList) break;
+
+        std::vector<int> cpus;
+        std::string range;
+
+        while(std::getline(cpuList, range, ',')){
+            int first = 0;
+            int last = 0;
+            char dash = 0;
+
+            std::stringstream stream(range);
+            stream >> first;
+            last = first;
+
+            if(stream >> dash >> last && dash != '-') last = first;
+
+            for(int cpu = first; cpu <= last; cpu++){
+                cpus.push_back(cpu);
+            }
+        }
+
+        if(!cpus.empty()) nodes.push_back(cpus);
+    }
+    #endif
+
+    if(nodes.empty()){
+        std::vector<int> cpus;
+        int cpusAmount = std::max(1u, std::thread::hardware_concurrency());
+
+        for(int cpu = 0; cpu < cpusAmount; cpu++){
+            cpus.push_back(cpu);
+        }
+
+        nodes.push_back(cpus);
+    }
+
+    return nodes;
+}
+
+//Restricts the calling thread to given CPUs
+//Returns false if it's not supported or the system refused
+inline bool pinCurrentThread(const std::vector<int>& cpus){
+    if(cpus.empty()) return false;
+
+    #if defined(_WIN32)
+    DWORD_PTR mask = 0;
+
+    for(int cpu : cpus){
+        if(cpu < (int)sizeof(DWORD_PTR) * 8) mask |= DWORD_PTR(1) << cpu;
+    }
+
+    return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+    #elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for(int cpu : cpus){
+        if(cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    #else
+    return false;
+    #endif
+}
+
+//Turns list of CPUs into text like "0-3,8"
+inline std::string formatCpuList(const std::vector<int>& cpus){
+    std::string text;
+
+    for(int i = 0; i < (int)cpus.size(); i++){
+        int first = cpus[i];
+
+        while(i + 1 < (int)cpus.size() && cpus[i + 1] == cpus[i] + 1) i++;
+
+        if(!text.empty()) text += ",";
+
+        text += std::to_string(first);
+
+        if(cpus[i] != first) text += "-" + std::to_string(cpus[i]);
+    }
+
+    return text;
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//Minimal PNG encoder without any library, for frames written without a window
+//Image data is compressed with deflate using the fixed Huffman codes and matches found in hash chains.
+//It's far from the best compression, but frames made of repeated tiles shrink many times,
+//and it costs little enough to keep up with the simulation on the threads of the exporter
+class PNGEncoder{
+    private:
+        //---Deflate---
+        //Codes of lengths 257-285 and distances 0-29: smallest value and number of extra bits (RFC 1951, 3.2.5)
+        static constexpr int lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static constexpr int lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static constexpr int distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static constexpr int distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        static constexpr int windowSize = 32768;
+        static constexpr int minMatch = 3;
+        static constexpr int maxMatch = 258;
+        //Candidates checked for every position, more gives slightly smaller files for much more time
+        static constexpr int maxChain = 32;
+        static constexpr int hashBits = 15;
+
+        //Bits are packed starting from the lowest one of every byte, as deflate reads them
+        struct bitWriter{
+            std::vector<uint8_t>& output;
+            uint32_t buffer = 0;
+            int count = 0;
+
+            bitWriter(std::vector<uint8_t>& output) : output(output){}
+
+            void write(uint32_t bits, int amount){
+                buffer |= bits << count;
+                count += amount;
+
+                while(count >= 8){
+                    output.push_back(buffer);
+                    buffer >>= 8;
+                    count -= 8;
+                }
+            }
+
+            //Huffman codes are packed starting from their highest bit
+            void writeCode(uint32_t code, int length){
+                uint32_t reversed = 0;
+
+                for(int i = 0; i < length; i++){
+                    reversed = reversed << 1 | (code & 1);
+                    code >>= 1;
+                }
+
+                write(reversed, length);
+            }
+
+            void flush(){
+                if(count > 0) output.push_back(buffer);
+
+                buffer = 0;
+                count = 0;
+            }
+        };
+
+        //Fixed Huffman code of a literal (0-255), end of block (256) or length code (257-285), RFC 1951, 3.2.6
+        static void writeSymbol(bitWriter& writer, int symbol){
+            if(symbol < 144) writer.writeCode(0x30 + symbol, 8);
+            else if(symbol < 256) writer.writeCode(0x190 + symbol - 144, 9);
+            else if(symbol < 280) writer.writeCode(symbol - 256, 7);
+            else writer.writeCode(0xC0 + symbol - 280, 8);
+        }
+
+        static void writeMatch(bitWriter& writer, int length, int distance){
+            int lengthCode = 28;
+
+            while(lengthBase[lengthCode] > length) lengthCode--;
+
+            writeSymbol(writer, 257 + lengthCode);
+            writer.write(length - lengthBase[lengthCode], lengthExtra[lengthCode]);
+
+            int distanceCode = 29;
+
+            while(distanceBase[distanceCode] > distance) distanceCode--;
+
+            writer.writeCode(distanceCode, 5);
+            writer.write(distance - distanceBase[distanceCode], distanceExtra[distanceCode]);
+        }
+
+        static uint32_t hashAt(const std::vector<uint8_t>& data, int position){
+            uint32_t bytes = data[position] | data[position + 1] << 8 | data[position + 2] << 16;
+
+            return (bytes * 2654435761u) >> (32 - hashBits);
+        }
+
+        //Single block with fixed Huffman codes, every position takes the longest match
+        //among the last maxChain positions starting with the same 3 bytes
+        static void deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& output){
+            bitWriter writer(output);
+
+            //Last block, fixed Huffman codes
+            writer.write(1, 1);
+            writer.write(1, 2);
+
+            int size = data.size();
+
+            //Latest position with the given hash and, for every position in the window, the previous one with its hash
+            std::vector<int> head(1 << hashBits, -1);
+            std::vector<int> previous(windowSize, -1);
+
+            auto insert = [&](int position){
+                if(position + minMatch > size) return;
+
+                uint32_t hash = hashAt(data, position);
+
+                previous[position & (windowSize - 1)] = head[hash];
+                head[hash] = position;
+            };
+
+            int position = 0;
+
+            while(position < size){
+                int bestLength = 0;
+                int bestDistance = 0;
+
+                if(position + minMatch <= size){
+                    int maxLength = std::min(maxMatch, size - position);
+                    int candidate = head[hashAt(data, position)];
+
+                    for(int chain = 0; chain < maxChain && candidate >= 0 && position - candidate <= windowSize; chain++){
+                        //Candidate can only be better if it matches at the position the best one ended
+                        if(data[candidate + bestLength] == data[position + bestLength]){
+                            int length = 0;
+
+                            while(length < maxLength && data[candidate + length] == data[position + length]) length++;
+
+                            if(length > bestLength){
+                                bestLength = length;
+                                bestDistance = position - candidate;
+
+                                if(length == maxLength) break;
+                            }
+                        }
+
+                        candidate = previous[candidate & (windowSize - 1)];
+                    }
+                }
+
+                if(bestLength >= minMatch){
+                    writeMatch(writer, bestLength, bestDistance);
+
+                    for(int i = 0; i < bestLength; i++){
+                        insert(position + i);
+                    }
+
+                    position += bestLength;
+                }
+                else{
+                    writeSymbol(writer, data[position]);
+                    insert(position);
+
+                    position++;
+                }
+            }
+
+            writeSymbol(writer, 256);
+            writer.flush();
+        }
+
+        //Stored blocks without compression, for data that deflate would only make bigger (like noise)
+        static void store(const std::vector<uint8_t>& data, std::vector<uint8_t>& output){
+            size_t blocksAmount = std::max((data.size() + 65534) / 65535, (size_t)1);
+
+            for(size_t block = 0; block < blocksAmount; block++){
+                size_t start = block * 65535;
+                uint16_t length = std::min(data.size() - start, (size_t)65535);
+
+                output.push_back(block == blocksAmount - 1);
+                output.push_back(length);
+                output.push_back(length >> 8);
+                output.push_back(~length);
+                output.push_back((uint16_t)~length >> 8);
+                output.insert(output.end(), data.begin() + start, data.begin() + start + length);
+            }
+        }
+
+        static size_t storedSize(size_t dataSize){
+            return dataSize + std::max((dataSize + 65534) / 65535, (size_t)1) * 5;
+        }
+        //------
+
+        //Made once, static initialization is safe when many threads encode at once
+        static const std::vector<uint32_t>& crcTable(){
+            static const std::vector<uint32_t> table = []{
+                std::vector<uint32_t> values(256);
+
+                for(uint32_t i = 0; i < 256; i++){
+                    uint32_t value = i;
+
+                    for(int bit = 0; bit < 8; bit++){
+                        value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+                    }
+
+                    values[i] = value;
+                }
+
+                return values;
+            }();
+
+            return table;
+        }
+
+        static void writeBigEndian(std::vector<uint8_t>& output, uint32_t value){
+            output.push_back(value >> 24);
+            output.push_back(value >> 16);
+            output.push_back(value >> 8);
+            output.push_back(value);
+        }
+
+        //Length, type, data and CRC of type and data
+        static void writeChunk(std::vector<uint8_t>& output, const char* type, const std::vector<uint8_t>& data){
+            writeBigEndian(output, data.size());
+
+            size_t start = output.size();
+
+            output.insert(output.end(), type, type + 4);
+            output.insert(output.end(), data.begin(), data.end());
+
+            const std::vector<uint32_t>& table = crcTable();
+            uint32_t crc = 0xFFFFFFFF;
+
+            for(size_t i = start; i < output.size(); i++){
+                crc = table[(crc ^ output[i]) & 0xFF] ^ (crc >> 8);
+            }
+
+            writeBigEndian(output, crc ^ 0xFFFFFFFF);
+        }
+
+    public:
+        //Pixels are 4 bytes each (r g b a), row after row
+        static std::vector<uint8_t> encode(const uint8_t* pixels, int width, int height){
+            std::vector<uint8_t> output = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+            //---Header: size, 8 bits per channel, RGBA, no interlacing---
+            std::vector<uint8_t> header;
+            writeBigEndian(header, width);
+            writeBigEndian(header, height);
+            header.insert(header.end(), {8, 6, 0, 0, 0});
+
+            writeChunk(output, "IHDR", header);
+            //------
+
+            //---Image data: zlib stream with a single deflate block---
+            size_t rowBytes = (size_t)width * 4;
+            size_t rawSize = (rowBytes + 1) * height;
+
+            std::vector<uint8_t> data;
+            data.push_back(0x78);
+            data.push_back(0x01);
+
+            //Every row starts with filter type 0 (none)
+            std::vector<uint8_t> raw;
+            raw.reserve(rawSize);
+
+            for(int y = 0; y < height; y++){
+                raw.push_back(0);
+                raw.insert(raw.end(), pixels + y * rowBytes, pixels + (y + 1) * rowBytes);
+            }
+
+            deflate(raw, data);
+
+            if(data.size() - 2 > storedSize(rawSize)){
+                data.resize(2);
+                store(raw, data);
+            }
+
+            uint32_t adlerA = 1;
+            uint32_t adlerB = 0;
+
+            for(size_t i = 0; i < rawSize; i++){
+                adlerA = (adlerA + raw[i]) % 65521;
+                adlerB = (adlerB + adlerA) % 65521;
+            }
+
+            writeBigEndian(data, adlerB << 16 | adlerA);
+
+            writeChunk(output, "IDAT", data);
+            //------
+
+            writeChunk(output, "IEND", {});
+
+            return output;
+        }
+
+        static bool write(const std::string& fileName, const uint8_t* pixels, int width, int height){
+            std::vector<uint8_t> encoded = encode(pixels, width, height);
+            std::ofstream file(fileName, std::ios::binary);
+
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+            return (bool)file;
+        }
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "olcPixelGameEngine.h"
+#include "liquidSimulation.h"
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//Draws the matrix with tiles of the sprite sheet into an RGBA image on the CPU, without a window or GPU
+//Looks the same as the window at zoom 1: water tiles tinted by compression, falling water
+//as a half transparent full tile and solid blocks, all on black background.
+//Rows are split between threads of the scheduler.
+class SoftwareRenderer{
+    private:
+        //Tiles copied out of the sprite sheet, so it isn't needed after the constructor
+        //Tiles 0-3 are cells with 1, 2, 3 and at least 4 units of water, tile 4 is a solid block
+        static constexpr int tilesAmount = 5;
+        std::vector<olc::Pixel> tiles;
+        olc::vi2d tileSize;
+
+        //Size of the last image
+        int width = 0;
+        int height = 0;
+        //Pixels taken by one cell in both directions
+        int cellSize;
+
+        const olc::Pixel& tilePixel(int tile, int x, int y) const{
+            return tiles[(tile * tileSize.y + y) * tileSize.x + x];
+        }
+
+        //Same as drawing a tinted decal over black
+        static olc::Pixel blendOverBlack(olc::Pixel texture, int tint, int alpha){
+            int opacity = texture.a * alpha / 255;
+
+            return olc::Pixel(
+                texture.r * tint / 255 * opacity / 255,
+                texture.g * tint / 255 * opacity / 255,
+                texture.b * tint / 255 * opacity / 255
+            );
+        }
+
+        void drawCell(LiquidSimulation& simulation, int x, int y, olc::Pixel* pixels){
+            float value = simulation.getCellValue(x, y);
+            int roundedValue = round(value);
+            bool isFalling = simulation.isFalling(x, y);
+
+            int tile = -1;
+            int tint = 255;
+            int alpha = 255;
+
+            if(roundedValue == solidBlockID){
+                tile = 4;
+            }
+            else if(isFalling){
+                tile = 3;
+                tint = compressionTint(value, simulation.getMaxWaterValue());
+                alpha = 200;
+            }
+            else if(roundedValue > 0){
+                tile = std::min(roundedValue, 4) - 1;
+                tint = compressionTint(value, simulation.getMaxWaterValue());
+            }
+
+            for(int tileY = 0; tileY < cellSize; tileY++){
+                olc::Pixel* row = pixels + (size_t)(y * cellSize + tileY) * width + x * cellSize;
+
+                for(int tileX = 0; tileX < cellSize; tileX++){
+                    if(tile < 0){
+                        row[tileX] = olc::BLACK;
+                        continue;
+                    }
+
+                    //Nearest pixel of the tile, like a scaled decal
+                    const olc::Pixel& texture = tilePixel(tile, tileX * tileSize.x / cellSize, tileY * tileSize.y / cellSize);
+
+                    row[tileX] = blendOverBlack(texture, tint, alpha);
+                }
+            }
+        }
+
+    public:
+        SoftwareRenderer(olc::Sprite* spriteSheet, olc::vi2d tileSize, int cellSize)
+        : tileSize(tileSize), cellSize(std::max(cellSize, 1)){
+            tiles.resize(tilesAmount * tileSize.x * tileSize.y);
+
+            for(int tile = 0; tile < tilesAmount; tile++){
+                for(int y = 0; y < tileSize.y; y++){
+                    for(int x = 0; x < tileSize.x; x++){
+                        tiles[(tile * tileSize.y + y) * tileSize.x + x] = spriteSheet->GetPixel(tile * tileSize.x + x, y);
+                    }
+                }
+            }
+        }
+
+        //Tint of water darkened by compression, between 255 (no change) and 64 (dark)
+        static int compressionTint(float value, float maxWaterValue){
+            float compression = value - maxWaterValue;
+            int tint = 255;
+
+            //Interpolate compression to value between 255 (no change) and 64 (dark)
+            if(compression > 0){
+                tint = -191.f/(2 * maxWaterValue) * compression + 255.f;
+
+                if(tint < 64) tint = 64;
+            }
+
+            return tint;
+        }
+
+        //Draws whole matrix into the image, row after row, which is resized when needed
+        //Has to be called between steps. Falling marks are cleared afterwards, like when the window draws the matrix
+        void render(LiquidSimulation& simulation, std::vector<olc::Pixel>& image){
+            olc::vi2d size = simulation.getSize();
+
+            width = size.x * cellSize;
+            height = size.y * cellSize;
+            image.resize((size_t)width * height);
+
+            olc::Pixel* pixels = image.data();
+
+            TaskScheduler& scheduler = simulation.getScheduler();
+            TaskScheduler::taskGroup group;
+
+            //Few bands per thread, so threads that finish early can steal the rest
+            int bandHeight = std::max(size.y / (scheduler.threadsAmount() * 4), 1);
+
+            for(int top = 0; top < size.y; top += bandHeight){
+                int bottom = std::min(top + bandHeight, size.y);
+
+                scheduler.submit(group, [this, &simulation, pixels, size, top, bottom]{
+                    for(int y = top; y < bottom; y++){
+                        for(int x = 0; x < size.x; x++){
+                            drawCell(simulation, x, y, pixels);
+                        }
+                    }
+                });
+            }
+
+            scheduler.wait(group);
+
+            simulation.clearFalling();
+        }
+
+        int getWidth() const{
+            return width;
+        }
+
+        int getHeight() const{
+            return height;
+        }
+};
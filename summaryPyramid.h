@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+//Summaries of square blocks of cells, each level made of 2x2 blocks of the level below (like mipmaps)
+//Level k has blocks of 2^k x 2^k cells, level 0 are the cells themselves and isn't stored,
+//cells are read with a function given by the owner of the grid.
+//Blocks are updated in chunks: only chunks marked as changed are calculated again from their cells,
+//then only their ancestors on higher levels.
+class SummaryPyramid{
+    public:
+        struct summary{
+            double mass;
+            float maxPressure;
+            //Fraction is solidCells divided by the number of cells in the block
+            int solidCells;
+        };
+
+    private:
+        int width = 0;
+        int height = 0;
+        //Level of blocks that are marked as changed, chunks have 2^chunkLevel x 2^chunkLevel cells
+        int chunkLevel = 4;
+        //Given to create(), chunkLevel is smaller for tiny grids
+        int requestedChunkLevel = 4;
+
+        //levels[k - 1] holds blocks of level k, row after row
+        std::vector<std::vector<summary>> levels;
+        std::vector<int> levelWidths;
+        std::vector<int> levelHeights;
+
+        std::vector<char> dirtyChunks;
+        std::vector<int> dirtyList;
+
+        static summary combine(const summary& first, const summary& second){
+            return {first.mass + second.mass, std::max(first.maxPressure, second.maxPressure), first.solidCells + second.solidCells};
+        }
+
+        summary& block(int level, int x, int y){
+            return levels[level - 1][(size_t)y * levelWidths[level] + x];
+        }
+
+        //Calculates block from its 4 children, children outside of the grid are skipped
+        template <typename CellReader>
+        void calculateBlock(int level, int x, int y, CellReader& readCell){
+            summary result = {0, 0, 0};
+
+            for(int childY = y * 2; childY <= y * 2 + 1; childY++){
+                for(int childX = x * 2; childX <= x * 2 + 1; childX++){
+                    if(childX >= levelWidths[level - 1] || childY >= levelHeights[level - 1]) continue;
+
+                    result = combine(result, level == 1 ? readCell(childX, childY) : block(level - 1, childX, childY));
+                }
+            }
+
+            block(level, x, y) = result;
+        }
+
+    public:
+        //All blocks are marked as changed, memory is allocated again only when the size changed
+        void create(int newWidth, int newHeight, int newChunkLevel = 4){
+            if(!levelWidths.empty() && newWidth == width && newHeight == height && newChunkLevel == requestedChunkLevel){
+                markAll();
+                return;
+            }
+
+            width = newWidth;
+            height = newHeight;
+            requestedChunkLevel = newChunkLevel;
+
+            levels.clear();
+            levelWidths = {width};
+            levelHeights = {height};
+
+            //Highest level is a single block covering everything
+            while(levelWidths.back() > 1 || levelHeights.back() > 1){
+                levelWidths.push_back((levelWidths.back() + 1) / 2);
+                levelHeights.push_back((levelHeights.back() + 1) / 2);
+                levels.emplace_back((size_t)levelWidths.back() * levelHeights.back(), summary{0, 0, 0});
+            }
+
+            chunkLevel = std::max(std::min(newChunkLevel, levelsAmount() - 1), 1);
+
+            if(levelsAmount() == 1) chunkLevel = 0;
+
+            dirtyChunks.assign((size_t)levelWidths[chunkLevel] * levelHeights[chunkLevel], false);
+            dirtyList.clear();
+
+            markAll();
+        }
+
+        //Number of levels, cells included
+        int levelsAmount() const{
+            return levelWidths.size();
+        }
+
+        int levelWidth(int level) const{
+            return levelWidths[level];
+        }
+
+        int levelHeight(int level) const{
+            return levelHeights[level];
+        }
+
+        int getChunkLevel() const{
+            return chunkLevel;
+        }
+
+        int chunkIndex(int x, int y) const{
+            return (y >> chunkLevel) * levelWidths[chunkLevel] + (x >> chunkLevel);
+        }
+
+        void markChunk(int chunk){
+            if(!dirtyChunks[chunk]){
+                dirtyChunks[chunk] = true;
+                dirtyList.push_back(chunk);
+            }
+        }
+
+        //Has to be called for every cell that changed since the last update
+        void markCell(int x, int y){
+            markChunk(chunkIndex(x, y));
+        }
+
+        void markAll(){
+            for(int y = 0; y < height; y += 1 << chunkLevel){
+                for(int x = 0; x < width; x += 1 << chunkLevel){
+                    markCell(x, y);
+                }
+            }
+        }
+
+        //Chunks marked since the last update, they can be calculated in parallel with updateChunk()
+        const std::vector<int>& changedChunks() const{
+            return dirtyList;
+        }
+
+        //Calculates blocks of the chunk from its cells
+        //readCell(x, y) returns summary of a single cell
+        template <typename CellReader>
+        void updateChunk(int chunk, CellReader readCell){
+            int chunkX = chunk % levelWidths[chunkLevel];
+            int chunkY = chunk / levelWidths[chunkLevel];
+
+            for(int level = 1; level <= chunkLevel; level++){
+                int size = 1 << (chunkLevel - level);
+
+                for(int y = chunkY * size; y < std::min((chunkY + 1) * size, levelHeights[level]); y++){
+                    for(int x = chunkX * size; x < std::min((chunkX + 1) * size, levelWidths[level]); x++){
+                        calculateBlock(level, x, y, readCell);
+                    }
+                }
+            }
+        }
+
+        //Calculates levels above chunks for changed chunks and clears the marks
+        //Has to be called after all changed chunks were updated
+        template <typename CellReader>
+        void updateAncestors(CellReader readCell){
+            std::vector<int> changed = dirtyList;
+
+            for(int chunk : dirtyList){
+                dirtyChunks[chunk] = false;
+            }
+
+            dirtyList.clear();
+
+            for(int level = chunkLevel + 1; level < levelsAmount(); level++){
+                std::vector<int> parents;
+
+                for(int index : changed){
+                    int parent = (index / levelWidths[level - 1] / 2) * levelWidths[level] + (index % levelWidths[level - 1]) / 2;
+
+                    parents.push_back(parent);
+                }
+
+                std::sort(parents.begin(), parents.end());
+                parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+
+                for(int parent : parents){
+                    calculateBlock(level, parent % levelWidths[level], parent / levelWidths[level], readCell);
+                }
+
+                changed = std::move(parents);
+            }
+        }
+
+        //Summary of the block, level has to be at least 1
+        const summary& getBlock(int level, int x, int y) const{
+            return levels[level - 1][(size_t)y * levelWidths[level] + x];
+        }
+
+        //Number of cells of the block that are inside of the grid
+        int blockCells(int level, int x, int y) const{
+            int blockWidth = std::min((x + 1) << level, width) - (x << level);
+            int blockHeight = std::min((y + 1) << level, height) - (y << level);
+
+            return blockWidth * blockHeight;
+        }
+};
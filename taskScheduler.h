@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work stealing thread pool
+//Every thread has its own queue of tasks. Thread takes tasks from the back of its own queue
+//and when it's empty steals them from the front of other queues, so threads that finished
+//their work help the ones that still have a lot of it.
+//Queue 0 belongs to threads that are not part of the pool (like the main thread),
+//they help executing tasks while waiting for them.
+//Tasks can also be pinned to a thread, they are never stolen, which is needed for
+//things like first touch of memory or setting thread affinity.
+class TaskScheduler{
+    public:
+        //Counts unfinished tasks, wait() returns when all of them are done
+        struct taskGroup{
+            std::atomic<int> pending{0};
+        };
+
+    private:
+        struct task{
+            std::function<void()> function;
+            taskGroup* group;
+        };
+
+        struct taskQueue{
+            std::mutex mutex;
+            std::deque<task> tasks;
+            //Tasks that only the owner of the queue can take
+            std::deque<task> pinnedTasks;
+        };
+
+        std::vector<std::unique_ptr<taskQueue>> queues;
+        std::vector<std::thread> threads;
+
+        std::mutex sleepMutex;
+        std::condition_variable wakeUp;
+        std::atomic<int> queuedTasks{0};
+        bool stopping = false;
+
+        //Pool that owns the calling thread and index of its queue
+        inline static thread_local TaskScheduler* currentScheduler = nullptr;
+        inline static thread_local int currentQueue = 0;
+
+        int ownQueue(){
+            return currentScheduler == this ? currentQueue : 0;
+        }
+
+        void push(taskGroup& group, task newTask, int queueIndex, bool isPinned){
+            group.pending++;
+
+            {
+                taskQueue& queue = *queues[queueIndex];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+
+                if(isPinned) queue.pinnedTasks.push_back(std::move(newTask));
+                else queue.tasks.push_back(std::move(newTask));
+            }
+
+            queuedTasks++;
+
+            //Taking the lock makes sure that a thread going to sleep either sees the new task or gets notified
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+            }
+
+            //Pinned task needs its owner, which may not be the thread woken by notify_one
+            if(isPinned) wakeUp.notify_all();
+            else wakeUp.notify_one();
+        }
+
+        //Takes task from the back of own queue or from the front of other queues
+        bool takeTask(int queueIndex, task& result){
+            {
+                taskQueue& own = *queues[queueIndex];
+                std::lock_guard<std::mutex> lock(own.mutex);
+
+                if(!own.pinnedTasks.empty()){
+                    result = std::move(own.pinnedTasks.front());
+                    own.pinnedTasks.pop_front();
+                    queuedTasks--;
+
+                    return true;
+                }
+
+                if(!own.tasks.empty()){
+                    result = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    queuedTasks--;
+
+                    return true;
+                }
+            }
+
+            for(int i = 1; i < (int)queues.size(); i++){
+                taskQueue& victim = *queues[(queueIndex + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+
+                if(!victim.tasks.empty()){
+                    result = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    queuedTasks--;
+
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool runTask(int queueIndex){
+            task current;
+
+            if(!takeTask(queueIndex, current)) return false;
+
+            current.function();
+            current.group->pending--;
+
+            return true;
+        }
+
+        void workerLoop(int queueIndex, std::function<void()> threadStart){
+            currentScheduler = this;
+            currentQueue = queueIndex;
+
+            if(threadStart) threadStart();
+
+            while(true){
+                if(runTask(queueIndex)) continue;
+
+                std::unique_lock<std::mutex> lock(sleepMutex);
+
+                if(stopping) return;
+
+                //Tasks left in queues can be pinned to other threads, so instead of sleeping
+                //this thread only gives them time to take them
+                if(queuedTasks > 0){
+                    lock.unlock();
+                    std::this_thread::yield();
+
+                    continue;
+                }
+
+                wakeUp.wait(lock, [this]{ return stopping || queuedTasks > 0; });
+
+                if(stopping) return;
+            }
+        }
+
+    public:
+        //threadsAmount counts the thread that waits for tasks, so 1 means no additional threads
+        //threadStart is called on every new thread before it takes any task
+        TaskScheduler(int threadsAmount, std::function<void()> threadStart = nullptr){
+            if(threadsAmount < 1) threadsAmount = 1;
+
+            for(int i = 0; i < threadsAmount; i++){
+                queues.push_back(std::make_unique<taskQueue>());
+            }
+
+            for(int i = 1; i < threadsAmount; i++){
+                threads.emplace_back(&TaskScheduler::workerLoop, this, i, threadStart);
+            }
+        }
+
+        ~TaskScheduler(){
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+
+            wakeUp.notify_all();
+
+            for(std::thread& thread : threads){
+                thread.join();
+            }
+        }
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        int threadsAmount() const{
+            return queues.size();
+        }
+
+        //Index of the calling thread in this pool, 0 for threads from outside of it
+        int threadIndex(){
+            return ownQueue();
+        }
+
+        //Adds task to the queue of given thread, or of the calling thread if it's -1
+        //Other threads can still steal it, so it's only a hint where the task should run
+        void submit(taskGroup& group, std::function<void()> function, int queueIndex = -1){
+            if(queueIndex < 0 || queueIndex >= (int)queues.size()) queueIndex = ownQueue();
+
+            push(group, {std::move(function), &group}, queueIndex, false);
+        }
+
+        //Adds task that will be executed only by the thread with given index
+        //Tasks pinned to 0 are executed by a thread from outside of the pool in wait()
+        void submitPinned(taskGroup& group, std::function<void()> function, int queueIndex){
+            push(group, {std::move(function), &group}, queueIndex, true);
+        }
+
+        //Executes tasks (not only from this group) until every task of the group is done
+        void wait(taskGroup& group){
+            int queueIndex = ownQueue();
+
+            while(group.pending > 0){
+                if(!runTask(queueIndex)) std::this_thread::yield();
+            }
+        }
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "olcPixelGameEngine.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <math.h>
+#include <vector>
+
+//Cells covered by a brush moved along a segment, given row by row as spans
+//Every covered cell is in exactly one span and spans are already clipped to the grid,
+//so whoever fills them writes each cell once, whatever the size of the brush.
+//Square brush gives the same cells as stamping the square at every point of a Bresenham line,
+//round brush gives a capsule: cells whose centres are closer to the segment than the radius.
+class ThickLine{
+    public:
+        enum shapes {shape_square, shape_round};
+
+    private:
+        template <typename SpanFunction>
+        static void emitSpan(int y, float first, float last, olc::vi2d gridSize, SpanFunction& span){
+            int firstX = std::max((int)first, 0);
+            int lastX = std::min((int)last, gridSize.x - 1);
+
+            if(y >= 0 && y < gridSize.y && firstX <= lastX) span(y, firstX, lastX);
+        }
+
+        //Union of squares along a Bresenham line
+        //Line is monotone, so points of one row make a run of neighbouring x values, and the rows covered
+        //by squares of a run are the same for all its points. For every covered row only the first and the last
+        //run that reach it matter, runs between them lie between their ends.
+        template <typename SpanFunction>
+        static void rasterizeSquare(olc::vi2d start, olc::vi2d end, int brushSize, olc::vi2d gridSize, SpanFunction& span){
+            int top = std::min(start.y, end.y);
+            int rows = abs(end.y - start.y) + 1;
+
+            std::vector<int> runFirst(rows, gridSize.x + brushSize + 1);
+            std::vector<int> runLast(rows, -brushSize - 1);
+
+            //---Bresenham line, the same as it was drawn point by point---
+            int dx = abs(end.x - start.x);
+            int sx = start.x < end.x ? 1 : -1;
+
+            int dy = -abs(end.y - start.y);
+            int sy = start.y < end.y ? 1 : -1;
+
+            int err = dx + dy;
+
+            olc::vi2d point = start;
+
+            while(true){
+                int row = point.y - top;
+
+                runFirst[row] = std::min(runFirst[row], point.x);
+                runLast[row] = std::max(runLast[row], point.x);
+
+                if(point == end) break;
+
+                int e2 = 2 * err;
+
+                if(e2 >= dy){
+                    err += dy;
+                    point.x += sx;
+                }
+
+                if(e2 <= dx){
+                    err += dx;
+                    point.y += sy;
+                }
+            }
+            //------
+
+            int offset = brushOffset(brushSize);
+
+            int firstRow = std::max(top - offset, 0);
+            int lastRow = std::min(top + rows - 1 - offset + brushSize, gridSize.y - 1);
+
+            for(int y = firstRow; y <= lastRow; y++){
+                //Runs with squares reaching row y
+                int firstRun = std::max(y + offset - brushSize - top, 0);
+                int lastRun = std::min(y + offset - top, rows - 1);
+
+                int first = std::min(runFirst[firstRun], runFirst[lastRun]) - offset;
+                int last = std::max(runLast[firstRun], runLast[lastRun]) - offset + brushSize;
+
+                emitSpan(y, first, last, gridSize, span);
+            }
+        }
+
+        //Interval of x for which a * x + b is between low and high, false if it's empty
+        static bool clipLinear(float a, float b, float low, float high, float& first, float& last){
+            if(a == 0) return b >= low && b <= high;
+
+            float from = (low - b) / a;
+            float to = (high - b) / a;
+
+            if(from > to) std::swap(from, to);
+
+            first = std::max(first, from);
+            last = std::min(last, to);
+
+            return first <= last;
+        }
+
+        //Capsule made of discs at both ends and the band between them
+        //Capsule is convex, so its part in a row is a single interval: the union of the intervals of its three parts
+        template <typename SpanFunction>
+        static void rasterizeRound(olc::vi2d start, olc::vi2d end, int brushSize, olc::vi2d gridSize, SpanFunction& span){
+            //Centre of the brush is in the middle of the square brush of the same size
+            float shift = brushSize / 2.f - brushOffset(brushSize);
+            olc::vf2d a = olc::vf2d(start) + olc::vf2d(shift, shift);
+            olc::vf2d b = olc::vf2d(end) + olc::vf2d(shift, shift);
+            float radius = (brushSize + 1) / 2.f;
+
+            olc::vf2d direction = b - a;
+            float length = direction.mag();
+
+            int firstRow = std::max((int)floor(std::min(a.y, b.y) - radius), 0);
+            int lastRow = std::min((int)ceil(std::max(a.y, b.y) + radius), gridSize.y - 1);
+
+            //Cells touching the edge aren't flickering in and out because of rounding
+            const float epsilon = 0.001;
+
+            for(int y = firstRow; y <= lastRow; y++){
+                float first = INFINITY;
+                float last = -INFINITY;
+
+                for(const olc::vf2d& centre : {a, b}){
+                    float height = y - centre.y;
+
+                    if(fabs(height) > radius + epsilon) continue;
+
+                    float halfWidth = sqrt(std::max(radius * radius - height * height, 0.f)) + epsilon;
+
+                    first = std::min(first, centre.x - halfWidth);
+                    last = std::max(last, centre.x + halfWidth);
+                }
+
+                if(length > 0){
+                    float bandFirst = -INFINITY;
+                    float bandLast = INFINITY;
+                    olc::vf2d unit = direction / length;
+
+                    //Projection on the segment is between its ends and distance from its line is at most the radius
+                    bool isInBand = clipLinear(unit.x, (y - a.y) * unit.y - a.x * unit.x, 0, length, bandFirst, bandLast)
+                        && clipLinear(unit.y, -(y - a.y) * unit.x - a.x * unit.y, -radius - epsilon, radius + epsilon, bandFirst, bandLast);
+
+                    if(isInBand){
+                        first = std::min(first, bandFirst);
+                        last = std::max(last, bandLast);
+                    }
+                }
+
+                if(first > last) continue;
+
+                emitSpan(y, ceil(first), floor(last), gridSize, span);
+            }
+        }
+
+    public:
+        //Square brush of size b covers b + 1 cells in both directions, starting that many cells before its position
+        static int brushOffset(int brushSize){
+            return (brushSize + 1) / 2;
+        }
+
+        //Calls span(y, firstX, lastX) for every row with covered cells, both ends are included
+        template <typename SpanFunction>
+        static void rasterize(olc::vi2d start, olc::vi2d end, int brushSize, shapes shape, olc::vi2d gridSize, SpanFunction span){
+            brushSize = std::max(brushSize, 0);
+
+            if(shape == shape_round) rasterizeRound(start, end, brushSize, gridSize, span);
+            else rasterizeSquare(start, end, brushSize, gridSize, span);
+        }
+};